@@ -5,7 +5,8 @@
 #include <string.h>
 #include <sndfile.h>
 #include <math.h>
-#include "spandsp.h"
+#include "codec.h"
+#include "snr.h"
 #include </usr/include/spandsp/test_utils.h>
 
 #define BLOCK_LEN           160
@@ -14,20 +15,6 @@
 #define ENCODED_FILE_NAME   "g711.g711"
 #define OUT_FILE_NAME       "male_output_g711.wav"
 
-int64_t mse=0;
-int64_t sumInput=0;
-int sampleCnt=0;
-
-void updateSNR(int16_t input, int16_t output){
-    sumInput = sumInput + input*input;
-    mse = mse + (input-output)*(input-output);
-    sampleCnt++;
-}
-
-int16_t amp[65536];
-uint8_t ulaw_data[65536];
-uint8_t alaw_data[65536];
-
 const uint8_t alaw_1khz_sine[] = {0x34, 0x21, 0x21, 0x34, 0xB4, 0xA1, 0xA1, 0xB4};
 const uint8_t ulaw_1khz_sine[] = {0x1E, 0x0B, 0x0B, 0x1E, 0x9E, 0x8B, 0x8B, 0x9E};
 
@@ -50,6 +37,9 @@ static void compliance_tests(int log_audio)
     g711_state_t *enc_state;
     g711_state_t *transcode;
     g711_state_t *dec_state;
+    int16_t amp[65536];
+    uint8_t ulaw_data[65536];
+    uint8_t alaw_data[65536];
 
     outhandle = NULL;
     if (log_audio)
@@ -296,120 +286,6 @@ static void compliance_tests(int log_audio)
     printf("Tests passed.\n");
 }
 
-#define SF_MAX_HANDLE   32
-
-static int sf_close_at_exit_registered = false;
-
-static SNDFILE *sf_close_at_exit_list[SF_MAX_HANDLE] =
-{
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL
-};
-
-static void sf_close_at_exit(void)
-{
-    int i;
-
-    for (i = 0;  i < SF_MAX_HANDLE;  i++)
-    {
-        if (sf_close_at_exit_list[i])
-        {
-            sf_close(sf_close_at_exit_list[i]);
-            sf_close_at_exit_list[i] = NULL;
-        }
-    }
-}
-
-
-static int sf_record_handle(SNDFILE *handle)
-{
-    int i;
-
-    for (i = 0;  i < SF_MAX_HANDLE;  i++)
-    {
-        if (sf_close_at_exit_list[i] == NULL)
-            break;
-    }
-    if (i >= SF_MAX_HANDLE)
-        return -1;
-    sf_close_at_exit_list[i] = handle;
-    if (!sf_close_at_exit_registered)
-    {
-        atexit(sf_close_at_exit);
-        sf_close_at_exit_registered = true;
-    }
-    return 0;
-}
-
-SPAN_DECLARE(SNDFILE *) sf_open_telephony_read(const char *name, int channels)
-{
-    SNDFILE *handle;
-    SF_INFO info;
-
-    memset(&info, 0, sizeof(info));
-    if ((handle = sf_open(name, SFM_READ, &info)) == NULL)
-    {
-        fprintf(stderr, "    Cannot open audio file '%s' for reading\n", name);
-        exit(2);
-    }
-    if (info.samplerate != SAMPLE_RATE)
-    {
-        printf("    Unexpected sample rate in audio file '%s'\n", name);
-        exit(2);
-    }
-    if (info.channels != channels)
-    {
-        printf("    Unexpected number of channels in audio file '%s'\n", name);
-        exit(2);
-    }
-    sf_record_handle(handle);
-    return handle;
-}
-
-SPAN_DECLARE(SNDFILE *) sf_open_telephony_write(const char *name, int channels)
-{
-    SNDFILE *handle;
-    SF_INFO info;
-
-    memset(&info, 0, sizeof(info));
-    info.frames = 0;
-    info.samplerate = SAMPLE_RATE;
-    info.channels = channels;
-    info.format = SF_FORMAT_WAV | SF_FORMAT_PCM_16;
-    info.sections = 1;
-    info.seekable = 1;
-
-    if ((handle = sf_open(name, SFM_WRITE, &info)) == NULL)
-    {
-        fprintf(stderr, "    Cannot open audio file '%s' for writing\n", name);
-        exit(2);
-    }
-    sf_record_handle(handle);
-    return handle;
-}
-
-SPAN_DECLARE(int) sf_close_telephony(SNDFILE *handle)
-{
-    int res;
-    int i;
-
-    if ((res = sf_close(handle)) == 0)
-    {
-        for (i = 0;  i < SF_MAX_HANDLE;  i++)
-        {
-            if (sf_close_at_exit_list[i] == handle)
-            {
-                sf_close_at_exit_list[i] = NULL;
-                break;
-            }
-        }
-    }
-    return res;
-}
-
-
 int main(int argc, char *argv[])
 {
     SNDFILE *inhandle;
@@ -426,8 +302,10 @@ int main(int argc, char *argv[])
     int file;
     const char *in_file;
     const char *out_file;
-    g711_state_t *enc_state;
-    g711_state_t *dec_state;
+    codec_session_t enc_session;
+    codec_session_t dec_session;
+    codec_iov_t iov;
+    snr_state_t snr;
     int16_t indata[BLOCK_LEN];
     int16_t outdata[BLOCK_LEN];
     uint8_t g711data[BLOCK_LEN];
@@ -461,8 +339,7 @@ int main(int argc, char *argv[])
         inhandle = NULL;
         outhandle = NULL;
         file = -1;
-        enc_state = NULL;
-        dec_state = NULL;
+        snr_init(&snr);
         if (encode)
         {
             if ((inhandle = sf_open_telephony_read(in_file, 1)) == NULL)
@@ -470,7 +347,7 @@ int main(int argc, char *argv[])
                 fprintf(stderr, "    Cannot open audio file '%s'\n", in_file);
                 exit(2);
             }
-            enc_state = g711_init(NULL, law);
+            codec_session_init(&enc_session, CODEC_G711, law, 64000);
         }
         else
         {
@@ -487,7 +364,7 @@ int main(int argc, char *argv[])
                 fprintf(stderr, "    Cannot create audio file '%s'\n", out_file);
                 exit(2);
             }
-            dec_state = g711_init(NULL, law);
+            codec_session_init(&dec_session, CODEC_G711, law, 64000);
         }
         else
         {
@@ -504,7 +381,11 @@ int main(int argc, char *argv[])
                 samples = sf_readf_short(inhandle, indata, BLOCK_LEN);
                 if (samples <= 0)
                     break;
-                len2 = g711_encode(enc_state, g711data, indata, samples);
+                iov.session = &enc_session;
+                iov.in = indata;
+                iov.in_len = samples;
+                iov.out = g711data;
+                len2 = codec_encode_batch(&iov, 1);
                 for(int i=0;i<BLOCK_LEN;i++){
                     printf("%x||", indata[i]);
                 }
@@ -522,17 +403,22 @@ int main(int argc, char *argv[])
             }
             if (decode)
             {
-                len3 = g711_decode(dec_state, outdata, g711data, len2);
+                iov.session = &dec_session;
+                iov.in = g711data;
+                iov.in_len = len2;
+                iov.out = outdata;
+                len3 = codec_decode_batch(&iov, 1);
                 outframes = sf_writef_short(outhandle, outdata, len3);
                 if (outframes != len3)
                 {
                     fprintf(stderr, "    Error writing audio file\n");
                     exit(2);
                 }
-                for(int i=0;i<BLOCK_LEN;i++){
+                for(int i=0;i<len3;i++){
                     printf("%x||", outdata[i]);
-                    updateSNR(indata[i], outdata[i]);
                 }
+                if (encode)
+                    snr_update(&snr, indata, outdata, len3);
                 printf("\n----------------------------------------------------------------------\n");
             }
             else
@@ -567,9 +453,11 @@ int main(int argc, char *argv[])
             close(file);
         }
         printf("'%s' translated to '%s' using %s.\n", in_file, out_file, (law == G711_ALAW)  ?  "A-law"  :  "u-law");
-        float snr = 10*log10f(sumInput/(mse*1.0f));
-        printf("SNR = %f\n", snr);
-        printf("So luong mau: %d\n", sampleCnt);
+        if (encode  &&  decode)
+        {
+            printf("SNR = %f\n", snr_current_db(&snr));
+            printf("So luong mau: %d\n", snr.samples);
+        }
     }
     return 0;
 }
@@ -0,0 +1,165 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <math.h>
+#include "spandsp.h"
+
+#include "g711_mixer.h"
+
+#define BLOCK_LEN           160
+#define MAX_LEGS            500
+#define BENCH_SAMPLES       (8000*20)
+
+static const int leg_counts[] = {3, 5, 10, 25, 50, 100, 200, 300, 400, 500};
+
+/* The usual frame, a length which leaves a scalar tail after the 8 sample
+   SIMD steps, and the longest block the mixer accepts. */
+static const int block_lens[] = {BLOCK_LEN, 13, G711_MIXER_MAX_BLOCK};
+
+uint8_t leg_in[MAX_LEGS][G711_MIXER_MAX_BLOCK];
+uint8_t leg_out[MAX_LEGS][G711_MIXER_MAX_BLOCK];
+
+static double now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec*1.0e-9;
+}
+
+static void make_legs(int law, int legs, int frame, int len)
+{
+    g711_state_t *enc_state;
+    int16_t amp[G711_MIXER_MAX_BLOCK];
+    int i;
+    int j;
+
+    enc_state = g711_init(NULL, law);
+    for (i = 0;  i < legs;  i++)
+    {
+        /* A different tone on each leg, at a level that lets a few hundred
+           legs sum beyond 16 bits so the saturation path is exercised. */
+        for (j = 0;  j < len;  j++)
+            amp[j] = (int16_t) (2000.0*sin(2.0*M_PI*(200.0 + 7.0*i)*(frame*len + j)/SAMPLE_RATE));
+        g711_encode(enc_state, leg_in[i], amp, len);
+    }
+    g711_free(enc_state);
+}
+
+static int16_t expand(int law, uint8_t x)
+{
+    return (law == G711_ALAW)  ?  alaw_to_linear(x)  :  ulaw_to_linear(x);
+}
+
+static void compliance_tests(int law)
+{
+    g711_mixer_state_t *mixer;
+    const uint8_t *in[MAX_LEGS];
+    uint8_t *out[MAX_LEGS];
+    int legs;
+    int len;
+    int n;
+    int i;
+    int j;
+    int k;
+    int32_t sum;
+    uint8_t expected;
+
+    printf("Testing \"everyone but me\" mixing against a direct sum (%s).\n", (law == G711_ALAW)  ?  "A-law"  :  "u-law");
+    mixer = g711_mixer_init(NULL, law);
+    for (n = 0;  n < (int) (sizeof(block_lens)/sizeof(block_lens[0]));  n++)
+    {
+        len = block_lens[n];
+        for (legs = 1;  legs <= MAX_LEGS;  legs += 37)
+        {
+            make_legs(law, legs, legs, len);
+            for (i = 0;  i < legs;  i++)
+            {
+                in[i] = leg_in[i];
+                out[i] = leg_out[i];
+            }
+            if (g711_mixer_mix(mixer, out, in, legs, len) != len)
+            {
+                printf("Mixing gave the wrong length\n");
+                printf("Tests failed\n");
+                exit(2);
+            }
+            for (i = 0;  i < legs;  i++)
+            {
+                for (j = 0;  j < len;  j++)
+                {
+                    sum = 0;
+                    for (k = 0;  k < legs;  k++)
+                    {
+                        if (k != i)
+                            sum += expand(law, leg_in[k][j]);
+                    }
+                    if (sum > INT16_MAX)
+                        sum = INT16_MAX;
+                    else if (sum < INT16_MIN)
+                        sum = INT16_MIN;
+                    expected = (law == G711_ALAW)  ?  linear_to_alaw(sum)  :  linear_to_ulaw(sum);
+                    if (leg_out[i][j] != expected)
+                    {
+                        printf("%d legs, %d samples: leg %d sample %d is 0x%02x, expected 0x%02x\n", legs, len, i, j, leg_out[i][j], expected);
+                        printf("Tests failed\n");
+                        exit(2);
+                    }
+                }
+            }
+        }
+    }
+    g711_mixer_free(mixer);
+    printf("Tests passed.\n");
+}
+
+static void throughput_tests(int law)
+{
+    g711_mixer_state_t *mixer;
+    const uint8_t *in[MAX_LEGS];
+    uint8_t *out[MAX_LEGS];
+    int legs;
+    int frames;
+    int i;
+    int n;
+    double start;
+    double elapsed;
+
+    printf("Mixing throughput (%s, %d sample frames)\n", (law == G711_ALAW)  ?  "A-law"  :  "u-law", BLOCK_LEN);
+    printf("%6s %14s %14s %12s\n", "legs", "samples/s", "ns/leg/frame", "legs/core");
+    mixer = g711_mixer_init(NULL, law);
+    for (n = 0;  n < (int) (sizeof(leg_counts)/sizeof(leg_counts[0]));  n++)
+    {
+        legs = leg_counts[n];
+        make_legs(law, legs, 0, BLOCK_LEN);
+        for (i = 0;  i < legs;  i++)
+        {
+            in[i] = leg_in[i];
+            out[i] = leg_out[i];
+        }
+        /* Keep the work per leg count roughly constant. */
+        frames = BENCH_SAMPLES*MAX_LEGS/(legs*BLOCK_LEN);
+        start = now();
+        for (i = 0;  i < frames;  i++)
+            g711_mixer_mix(mixer, out, in, legs, BLOCK_LEN);
+        elapsed = now() - start;
+        /* legs/core is how many real time legs one core could carry, given one
+           frame per leg every 20ms. */
+        printf("%6d %14.0f %14.1f %12.0f\n",
+               legs,
+               (double) legs*frames*BLOCK_LEN/elapsed,
+               elapsed*1.0e9/((double) legs*frames),
+               (double) legs*frames*BLOCK_LEN/(elapsed*SAMPLE_RATE));
+    }
+    g711_mixer_free(mixer);
+}
+
+int main(int argc, char *argv[])
+{
+    compliance_tests(G711_ALAW);
+    compliance_tests(G711_ULAW);
+    throughput_tests(G711_ALAW);
+    throughput_tests(G711_ULAW);
+    return 0;
+}
@@ -0,0 +1,564 @@
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <string.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#include <sndfile.h>
+
+#include "codec.h"
+#include "pacer.h"
+
+#include </usr/include/spandsp/test_utils.h>
+
+#define BLOCK_LEN           160
+/* 1ms ticks, with one frame per channel every 20 ticks. */
+#define TICK_US             1000
+#define FRAME_TICKS         20
+#define SOURCE_LEN          (8000*10)
+
+#define IN_FILE_NAME        "male.wav"
+
+static const int channel_counts[] = {1000, 10000, 50000};
+
+enum
+{
+    MODE_BATCH = 0,
+    MODE_CORO
+};
+
+typedef struct bench_thread_s bench_thread_t;
+
+typedef struct
+{
+    pacer_timer_t timer;
+    codec_session_t enc;
+    codec_session_t dec;
+    bench_thread_t *thread;
+    int offset;
+    int frames;
+} bench_channel_t;
+
+struct bench_thread_s
+{
+    pthread_t thread;
+    pacer_state_t pacer;
+    int mode;
+    /* The CPU this thread, and so its pacer, is pinned to. */
+    int cpu;
+    bench_channel_t *channels;
+    int count;
+    uint64_t ticks;
+    /* Batch workspace, sized for every channel of the thread. */
+    codec_iov_t *iov;
+    uint8_t *g711data;
+    int16_t *amp_out;
+    /* How late each tick's frames were finished, in nanoseconds, or NO_WORK
+       for ticks where nothing was due. */
+    int64_t *lateness;
+    double cpu_seconds;
+    double wall_seconds;
+};
+
+#define NO_WORK             INT64_MIN
+
+static int16_t source[SOURCE_LEN];
+static int source_len;
+
+/* The CPUs this process may run on. Worker threads are pinned to them in
+   turn, so each pacer and its figures belong to one core. */
+static int cpus[CPU_SETSIZE];
+static int cpu_count;
+
+static int64_t now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t) ts.tv_sec*1000000000 + ts.tv_nsec;
+}
+
+static void record_lateness(bench_thread_t *t, uint64_t tick)
+{
+    int64_t late;
+
+    if (tick >= t->ticks)
+        return;
+    late = now_ns() - pacer_tick_time_ns(&t->pacer, tick);
+    if (late > t->lateness[tick])
+        t->lateness[tick] = late;
+}
+
+static const int16_t *channel_frame(bench_channel_t *ch)
+{
+    return &source[(ch->offset + ch->frames++*BLOCK_LEN)%(source_len - BLOCK_LEN)];
+}
+
+/* Every channel due in a tick is coded in one encode and one decode batch. */
+static void batch_handler(void *user_data, pacer_timer_t *due[], int n, uint64_t tick)
+{
+    bench_thread_t *t;
+    bench_channel_t *ch;
+    int i;
+
+    t = (bench_thread_t *) user_data;
+    for (i = 0;  i < n;  i++)
+    {
+        ch = (bench_channel_t *) due[i]->user_data;
+        t->iov[i].session = &ch->enc;
+        t->iov[i].in = channel_frame(ch);
+        t->iov[i].in_len = BLOCK_LEN;
+        t->iov[i].out = &t->g711data[i*BLOCK_LEN];
+    }
+    codec_encode_batch(t->iov, n);
+    for (i = 0;  i < n;  i++)
+    {
+        ch = (bench_channel_t *) due[i]->user_data;
+        t->iov[i].session = &ch->dec;
+        t->iov[i].in = &t->g711data[i*BLOCK_LEN];
+        t->iov[i].in_len = BLOCK_LEN;
+        t->iov[i].out = &t->amp_out[i*BLOCK_LEN];
+    }
+    codec_decode_batch(t->iov, n);
+    record_lateness(t, tick);
+}
+
+/* The same work as one coroutine per call, which codes its own frame each
+   time it wakes. */
+static uint32_t call_coro(pacer_timer_t *timer)
+{
+    bench_channel_t *ch;
+    bench_thread_t *t;
+    codec_iov_t iov;
+    uint8_t g711data[BLOCK_LEN];
+    int16_t amp_out[BLOCK_LEN];
+
+    ch = (bench_channel_t *) timer->user_data;
+    t = ch->thread;
+    PACER_CORO_BEGIN(timer);
+    for (;;)
+    {
+        iov.session = &ch->enc;
+        iov.in = channel_frame(ch);
+        iov.in_len = BLOCK_LEN;
+        iov.out = g711data;
+        codec_encode_batch(&iov, 1);
+        iov.session = &ch->dec;
+        iov.in = g711data;
+        iov.out = amp_out;
+        codec_decode_batch(&iov, 1);
+        record_lateness(t, timer->expires);
+        PACER_CORO_SLEEP(timer, FRAME_TICKS);
+    }
+    PACER_CORO_END(timer);
+}
+
+static void *worker(void *arg)
+{
+    bench_thread_t *t;
+    struct timespec start;
+    struct timespec end;
+    cpu_set_t cpu_set;
+    int64_t wall;
+    int i;
+
+    t = (bench_thread_t *) arg;
+    CPU_ZERO(&cpu_set);
+    CPU_SET(t->cpu, &cpu_set);
+    if (pthread_setaffinity_np(pthread_self(), sizeof(cpu_set), &cpu_set))
+    {
+        fprintf(stderr, "    Cannot pin thread to CPU %d\n", t->cpu);
+        exit(2);
+    }
+    if (pacer_init(&t->pacer, TICK_US, batch_handler, t) == NULL)
+    {
+        fprintf(stderr, "    Cannot create pacer\n");
+        exit(2);
+    }
+    /* Spread the channels evenly over the ticks of a frame. */
+    for (i = 0;  i < t->count;  i++)
+    {
+        if (t->mode == MODE_BATCH)
+            pacer_add(&t->pacer, &t->channels[i].timer, i%FRAME_TICKS, FRAME_TICKS, &t->channels[i]);
+        else
+            pacer_add_coro(&t->pacer, &t->channels[i].timer, i%FRAME_TICKS, call_coro, &t->channels[i]);
+    }
+    wall = now_ns();
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &start);
+    while (t->pacer.now < t->ticks)
+    {
+        if (pacer_run(&t->pacer, 100) < 0)
+        {
+            fprintf(stderr, "    Pacer wait failed\n");
+            exit(2);
+        }
+    }
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &end);
+    t->cpu_seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec)*1.0e-9;
+    t->wall_seconds = (now_ns() - wall)*1.0e-9;
+    pacer_release(&t->pacer);
+    return NULL;
+}
+
+static int compare_int64(const void *a, const void *b)
+{
+    int64_t x;
+    int64_t y;
+
+    x = *(const int64_t *) a;
+    y = *(const int64_t *) b;
+    return (x > y) - (x < y);
+}
+
+static void run(int mode, int channels, int threads, int seconds)
+{
+    bench_channel_t *chans;
+    bench_thread_t *workers;
+    int64_t *lateness;
+    uint64_t ticks;
+    uint64_t worked;
+    uint64_t k;
+    uint64_t overruns;
+    double cpu_seconds;
+    double wall_seconds;
+    int per_thread;
+    int first;
+    int n;
+    int i;
+    int j;
+
+    ticks = (uint64_t) seconds*1000000/TICK_US;
+    chans = (bench_channel_t *) calloc(channels, sizeof(*chans));
+    workers = (bench_thread_t *) calloc(threads, sizeof(*workers));
+    lateness = (int64_t *) malloc(ticks*threads*sizeof(*lateness));
+    if (chans == NULL  ||  workers == NULL  ||  lateness == NULL)
+    {
+        fprintf(stderr, "    Out of memory\n");
+        exit(2);
+    }
+    for (k = 0;  k < ticks*threads;  k++)
+        lateness[k] = NO_WORK;
+    per_thread = channels/threads;
+    first = 0;
+    for (i = 0;  i < threads;  i++)
+    {
+        n = per_thread + ((i < channels%threads)  ?  1  :  0);
+        workers[i].mode = mode;
+        workers[i].cpu = cpus[i%cpu_count];
+        workers[i].channels = &chans[first];
+        workers[i].count = n;
+        workers[i].ticks = ticks;
+        workers[i].lateness = &lateness[i*ticks];
+        workers[i].iov = (codec_iov_t *) malloc(n*sizeof(codec_iov_t));
+        workers[i].g711data = (uint8_t *) malloc(n*BLOCK_LEN);
+        workers[i].amp_out = (int16_t *) malloc(n*BLOCK_LEN*sizeof(int16_t));
+        if (workers[i].iov == NULL  ||  workers[i].g711data == NULL  ||  workers[i].amp_out == NULL)
+        {
+            fprintf(stderr, "    Out of memory\n");
+            exit(2);
+        }
+        for (j = 0;  j < n;  j++)
+        {
+            codec_session_init(&chans[first + j].enc, CODEC_G711, G711_ALAW, 64000);
+            codec_session_init(&chans[first + j].dec, CODEC_G711, G711_ALAW, 64000);
+            chans[first + j].thread = &workers[i];
+            chans[first + j].offset = (first + j)*7919%(source_len - BLOCK_LEN);
+        }
+        first += n;
+    }
+    for (i = 0;  i < threads;  i++)
+        pthread_create(&workers[i].thread, NULL, worker, &workers[i]);
+    cpu_seconds = 0.0;
+    wall_seconds = 0.0;
+    overruns = 0;
+    for (i = 0;  i < threads;  i++)
+    {
+        pthread_join(workers[i].thread, NULL);
+        cpu_seconds += workers[i].cpu_seconds;
+        wall_seconds += workers[i].wall_seconds;
+        overruns += workers[i].pacer.overruns;
+        free(workers[i].iov);
+        free(workers[i].g711data);
+        free(workers[i].amp_out);
+    }
+
+    /* Only ticks where a thread had channels due say anything about jitter. */
+    worked = 0;
+    for (k = 0;  k < ticks*threads;  k++)
+    {
+        if (lateness[k] != NO_WORK)
+            lateness[worked++] = lateness[k];
+    }
+    if (worked == 0)
+        lateness[worked++] = 0;
+    qsort(lateness, worked, sizeof(*lateness), compare_int64);
+    printf("%-6s %8d %7d %10.1f %10.1f %10.1f %9llu %12.2f %8.1f%%\n",
+           (mode == MODE_BATCH)  ?  "batch"  :  "coro",
+           channels,
+           threads,
+           lateness[worked/2]/1000.0,
+           lateness[worked*99/100]/1000.0,
+           lateness[worked - 1]/1000.0,
+           (unsigned long long) overruns,
+           cpu_seconds*1.0e6/((double) channels*seconds),
+           cpu_seconds*100.0/wall_seconds);
+    free(lateness);
+    free(workers);
+    free(chans);
+}
+
+static void check_handler(void *user_data, pacer_timer_t *due[], int n, uint64_t tick)
+{
+    int i;
+
+    for (i = 0;  i < n;  i++)
+    {
+        if (due[i]->expires - due[i]->period != tick)
+        {
+            printf("Timer due at tick %llu fired at tick %llu\n",
+                   (unsigned long long) (due[i]->expires - due[i]->period),
+                   (unsigned long long) tick);
+            printf("Tests failed\n");
+            exit(2);
+        }
+        (*(int *) due[i]->user_data)++;
+    }
+}
+
+typedef struct
+{
+    pacer_state_t *pacer;
+    int runs;
+    int i;
+    /*! The tick at which the coroutine should next run. */
+    uint64_t due;
+} coro_check_t;
+
+static const uint32_t coro_sleeps[] = {1, 300, 20000, 5, 70000, 255, 256};
+
+static void check_coro_due(coro_check_t *c)
+{
+    c->runs++;
+    if (c->pacer->now - 1 != c->due)
+    {
+        printf("Coroutine due at tick %llu ran at tick %llu\n",
+               (unsigned long long) c->due,
+               (unsigned long long) (c->pacer->now - 1));
+        printf("Tests failed\n");
+        exit(2);
+    }
+}
+
+/* Sleeps for a series of delays which land in each level of the wheel. */
+static uint32_t sleeping_coro(pacer_timer_t *t)
+{
+    coro_check_t *c;
+
+    c = (coro_check_t *) t->user_data;
+    PACER_CORO_BEGIN(t);
+    for (c->i = 0;  c->i < (int) (sizeof(coro_sleeps)/sizeof(coro_sleeps[0]));  c->i++)
+    {
+        check_coro_due(c);
+        c->due += coro_sleeps[c->i];
+        PACER_CORO_SLEEP(t, coro_sleeps[c->i]);
+    }
+    check_coro_due(c);
+    PACER_CORO_END(t);
+}
+
+/* Cancels its own timer on its second run. */
+static uint32_t cancelling_coro(pacer_timer_t *t)
+{
+    coro_check_t *c;
+
+    c = (coro_check_t *) t->user_data;
+    check_coro_due(c);
+    if (c->runs == 2)
+    {
+        pacer_cancel(c->pacer, t);
+        /* This must be ignored, as the timer is no longer active. */
+        return FRAME_TICKS;
+    }
+    c->due += FRAME_TICKS;
+    return FRAME_TICKS;
+}
+
+/* Cancels and re-adds its own timer on its first run, and finishes on the
+   second. */
+static uint32_t readding_coro(pacer_timer_t *t)
+{
+    coro_check_t *c;
+
+    c = (coro_check_t *) t->user_data;
+    check_coro_due(c);
+    if (c->runs == 1)
+    {
+        pacer_cancel(c->pacer, t);
+        c->due = c->pacer->now + 1000;
+        pacer_add_coro(c->pacer, t, 1000, readding_coro, c);
+        /* This must be ignored, as the timer has been re-added. */
+        return 1;
+    }
+    return 0;
+}
+
+static void check_coro_runs(const char *name, const pacer_timer_t *t, const coro_check_t *c, int runs)
+{
+    if (c->runs != runs  ||  t->active)
+    {
+        printf("%s coroutine ran %d times, expected %d, and is %sactive\n", name, c->runs, runs, (t->active)  ?  ""  :  "not ");
+        printf("Tests failed\n");
+        exit(2);
+    }
+}
+
+static void wheel_tests(void)
+{
+    static const uint32_t delays[] = {0, 1, 19, 255, 256, 257, 16383, 16384, 16385, 100000, 1048576, 3000000};
+    pacer_state_t pacer;
+    pacer_timer_t timers[sizeof(delays)/sizeof(delays[0])];
+    pacer_timer_t periodic;
+    pacer_timer_t coros[3];
+    coro_check_t checks[3];
+    int fired[sizeof(delays)/sizeof(delays[0])];
+    int periodic_fired;
+    int i;
+
+    printf("Timer wheel tests.\n");
+    if (pacer_init(&pacer, TICK_US, check_handler, NULL) == NULL)
+    {
+        fprintf(stderr, "    Cannot create pacer\n");
+        exit(2);
+    }
+    memset(timers, 0, sizeof(timers));
+    memset(&periodic, 0, sizeof(periodic));
+    for (i = 0;  i < (int) (sizeof(delays)/sizeof(delays[0]));  i++)
+    {
+        fired[i] = 0;
+        pacer_add(&pacer, &timers[i], delays[i], 0, &fired[i]);
+    }
+    periodic_fired = 0;
+    pacer_add(&pacer, &periodic, 3, FRAME_TICKS, &periodic_fired);
+    memset(coros, 0, sizeof(coros));
+    memset(checks, 0, sizeof(checks));
+    for (i = 0;  i < 3;  i++)
+    {
+        checks[i].pacer = &pacer;
+        checks[i].due = pacer.now + 3 + i;
+    }
+    pacer_add_coro(&pacer, &coros[0], 3, sleeping_coro, &checks[0]);
+    pacer_add_coro(&pacer, &coros[1], 4, cancelling_coro, &checks[1]);
+    pacer_add_coro(&pacer, &coros[2], 5, readding_coro, &checks[2]);
+    pacer_advance(&pacer, 3000001);
+    for (i = 0;  i < (int) (sizeof(delays)/sizeof(delays[0]));  i++)
+    {
+        if (fired[i] != 1)
+        {
+            printf("Timer with delay %u fired %d times\n", delays[i], fired[i]);
+            printf("Tests failed\n");
+            exit(2);
+        }
+    }
+    if (periodic_fired != (3000001 - 3 + FRAME_TICKS - 1)/FRAME_TICKS)
+    {
+        printf("Periodic timer fired %d times\n", periodic_fired);
+        printf("Tests failed\n");
+        exit(2);
+    }
+    check_coro_runs("Sleeping", &coros[0], &checks[0], (int) (sizeof(coro_sleeps)/sizeof(coro_sleeps[0])) + 1);
+    check_coro_runs("Cancelling", &coros[1], &checks[1], 2);
+    check_coro_runs("Re-adding", &coros[2], &checks[2], 2);
+    /* A cancelled coroutine's timer must be free for reuse, and must only be
+       in the wheel once when it is. */
+    checks[1].runs = 0;
+    checks[1].due = pacer.now + 10;
+    if (pacer_add_coro(&pacer, &coros[1], 10, cancelling_coro, &checks[1]))
+    {
+        printf("Cannot re-add a cancelled coroutine\n");
+        printf("Tests failed\n");
+        exit(2);
+    }
+    pacer_advance(&pacer, 1000);
+    check_coro_runs("Re-added cancelling", &coros[1], &checks[1], 2);
+    pacer_release(&pacer);
+    printf("Tests passed.\n");
+}
+
+static void usage(void)
+{
+    printf("Usage: G711_pace [-p threads, pinned to the available CPUs in turn] [-s seconds]\n");
+}
+
+int main(int argc, char *argv[])
+{
+    SNDFILE *inhandle;
+    cpu_set_t cpu_set;
+    int opt;
+    int threads;
+    int seconds;
+    int i;
+
+    CPU_ZERO(&cpu_set);
+    if (sched_getaffinity(0, sizeof(cpu_set), &cpu_set))
+    {
+        fprintf(stderr, "    Cannot read the CPU affinity\n");
+        exit(2);
+    }
+    cpu_count = 0;
+    for (i = 0;  i < CPU_SETSIZE;  i++)
+    {
+        if (CPU_ISSET(i, &cpu_set))
+            cpus[cpu_count++] = i;
+    }
+    threads = cpu_count;
+    seconds = 2;
+    while ((opt = getopt(argc, argv, "hp:s:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'p':
+            threads = atoi(optarg);
+            break;
+        case 's':
+            seconds = atoi(optarg);
+            break;
+        default:
+            usage();
+            exit(2);
+        }
+    }
+    if (threads < 1  ||  seconds < 1)
+    {
+        usage();
+        exit(2);
+    }
+
+    if ((inhandle = sf_open_telephony_read(IN_FILE_NAME, 1)) == NULL)
+    {
+        fprintf(stderr, "    Cannot open audio file '%s'\n", IN_FILE_NAME);
+        exit(2);
+    }
+    if ((source_len = sf_readf_short(inhandle, source, SOURCE_LEN)) <= BLOCK_LEN)
+    {
+        fprintf(stderr, "    Audio file '%s' is too short\n", IN_FILE_NAME);
+        exit(2);
+    }
+    if (sf_close_telephony(inhandle))
+    {
+        fprintf(stderr, "    Cannot close audio file '%s'\n", IN_FILE_NAME);
+        exit(2);
+    }
+
+    wheel_tests();
+
+    printf("G.711 channels paced at one %d sample frame per %dms, %dus ticks, %ds per run\n", BLOCK_LEN, FRAME_TICKS*TICK_US/1000, TICK_US, seconds);
+    printf("%-6s %8s %7s %10s %10s %10s %9s %12s %9s\n", "mode", "channels", "threads", "p50 us", "p99 us", "max us", "overruns", "CPU us/ch/s", "core");
+    for (i = 0;  i < (int) (sizeof(channel_counts)/sizeof(channel_counts[0]));  i++)
+    {
+        run(MODE_BATCH, channel_counts[i], threads, seconds);
+        run(MODE_CORO, channel_counts[i], threads, seconds);
+    }
+    return 0;
+}
@@ -0,0 +1,129 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <sndfile.h>
+#include <math.h>
+
+#include "codec.h"
+#include "snr.h"
+
+#include </usr/include/spandsp/test_utils.h>
+
+#define BLOCK_LEN           160
+/* Step the rate every 500ms. */
+#define SWITCH_FRAMES       25
+
+#define IN_FILE_NAME        "male.wav"
+
+enum
+{
+    SWITCH_NONE = 0,
+    SWITCH_KEEP_STATE,
+    SWITCH_REINIT
+};
+
+static const int rates[] = {40000, 32000, 24000, 16000};
+
+/* Down from 40 to 16 kbit/s and back up again, as a call would be stepped
+   under congestion. */
+static const int schedule[] = {40000, 32000, 24000, 16000, 24000, 32000};
+
+static void run(const char *name, int mode, int bit_rate, snr_state_t *total, snr_state_t *transient)
+{
+    SNDFILE *inhandle;
+    codec_session_t enc_session;
+    codec_session_t dec_session;
+    codec_iov_t iov;
+    int16_t amp[BLOCK_LEN];
+    int16_t amp_out[BLOCK_LEN];
+    uint8_t adpcmdata[BLOCK_LEN];
+    int frames;
+    int frame;
+    int step;
+
+    if ((inhandle = sf_open_telephony_read(name, 1)) == NULL)
+    {
+        fprintf(stderr, "    Cannot open audio file '%s'\n", name);
+        exit(2);
+    }
+    if (mode != SWITCH_NONE)
+        bit_rate = schedule[0];
+    codec_session_init(&enc_session, CODEC_G726, G726_ENCODING_LINEAR, bit_rate);
+    codec_session_init(&dec_session, CODEC_G726, G726_ENCODING_LINEAR, bit_rate);
+    snr_init(total);
+    snr_init(transient);
+    step = 0;
+    for (frame = 0;  (frames = sf_readf_short(inhandle, amp, BLOCK_LEN)) > 0;  frame++)
+    {
+        if (mode != SWITCH_NONE  &&  frame > 0  &&  frame%SWITCH_FRAMES == 0)
+        {
+            step = (step + 1)%(int) (sizeof(schedule)/sizeof(schedule[0]));
+            if (mode == SWITCH_KEEP_STATE)
+            {
+                if (codec_session_set_bit_rate(&enc_session, schedule[step])
+                    ||
+                    codec_session_set_bit_rate(&dec_session, schedule[step]))
+                {
+                    printf("Rate switch to %dbps failed\n", schedule[step]);
+                    printf("Tests failed\n");
+                    exit(2);
+                }
+            }
+            else
+            {
+                codec_session_init(&enc_session, CODEC_G726, G726_ENCODING_LINEAR, schedule[step]);
+                codec_session_init(&dec_session, CODEC_G726, G726_ENCODING_LINEAR, schedule[step]);
+            }
+        }
+        iov.session = &enc_session;
+        iov.in = amp;
+        iov.in_len = frames;
+        iov.out = adpcmdata;
+        codec_encode_batch(&iov, 1);
+        iov.session = &dec_session;
+        iov.in = adpcmdata;
+        iov.in_len = iov.out_len;
+        iov.out = amp_out;
+        codec_decode_batch(&iov, 1);
+        snr_update(total, amp, amp_out, iov.out_len);
+        /* The frame straight after each change shows any transient. */
+        if (mode != SWITCH_NONE  &&  frame > 0  &&  frame%SWITCH_FRAMES == 0)
+            snr_update(transient, amp, amp_out, iov.out_len);
+    }
+    if (sf_close_telephony(inhandle))
+    {
+        fprintf(stderr, "    Cannot close audio file '%s'\n", name);
+        exit(2);
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    snr_state_t total;
+    snr_state_t transient;
+    snr_state_t reinit_total;
+    snr_state_t reinit_transient;
+    int i;
+
+    printf("Fixed rate\n");
+    for (i = 0;  i < (int) (sizeof(rates)/sizeof(rates[0]));  i++)
+    {
+        run(IN_FILE_NAME, SWITCH_NONE, rates[i], &total, &transient);
+        printf("    %5dbps  SNR = %f\n", rates[i], snr_current_db(&total));
+    }
+
+    printf("Switching 40->32->24->16->24->32kbps every %dms\n", SWITCH_FRAMES*BLOCK_LEN/8);
+    run(IN_FILE_NAME, SWITCH_KEEP_STATE, 0, &total, &transient);
+    run(IN_FILE_NAME, SWITCH_REINIT, 0, &reinit_total, &reinit_transient);
+    printf("    %-22s %12s %18s\n", "", "SNR", "post-switch SNR");
+    printf("    %-22s %12f %18f\n", "keeping state", snr_current_db(&total), snr_current_db(&transient));
+    printf("    %-22s %12f %18f\n", "free and re-init", snr_current_db(&reinit_total), snr_current_db(&reinit_transient));
+    if (snr_current_db(&transient) < snr_current_db(&reinit_transient))
+    {
+        printf("Keeping state across a switch gave a worse transient than re-initialising\n");
+        printf("Tests failed\n");
+        exit(2);
+    }
+    printf("Tests passed.\n");
+    return 0;
+}
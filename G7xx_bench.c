@@ -0,0 +1,643 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+#include <sndfile.h>
+#include <math.h>
+
+#include "codec.h"
+#include "snr.h"
+
+#include </usr/include/spandsp/test_utils.h>
+
+#define BLOCK_LEN           160
+
+#define IN_FILE_NAME        "male.wav"
+
+#define MAX_RESULTS         1024
+
+/* The whole sweep is measured several times, so the runs of each point are
+   spread over the length of the benchmark rather than all falling in one
+   busy moment. Throughput is taken from the best run, since noise from the
+   rest of the machine only ever slows a run down. Latency percentiles are
+   taken as the median over the runs, so one disturbed run cannot move them,
+   but a real shift in the tail still does. */
+#define DEFAULT_REPEATS     5
+#define MAX_REPEATS         32
+
+/* Every run codes at least this many frames, spread across its channels, so
+   thread start up does not dominate a run with few channels, and p99.9 has
+   enough samples behind it. */
+#define MIN_RUN_FRAMES      10000
+
+/* A percentile is only reported when at least this many samples lie beyond
+   it. With fewer, p99 of a short run is really just its maximum. */
+#define MIN_TAIL_SAMPLES    10
+
+/* Latency histogram: 32 buckets per octave of nanoseconds, so adjacent
+   buckets are at most ~3% apart, well inside the default 10% gate. */
+#define HIST_SUB_BITS       5
+#define HIST_BUCKETS        (32 << HIST_SUB_BITS)
+
+typedef struct
+{
+    int codec;
+    int law;
+    int bit_rate;
+    const char *name;
+} bench_codec_t;
+
+static const bench_codec_t codecs[] =
+{
+    {CODEC_G711, G711_ALAW, 64000, "g711"},
+    {CODEC_G726, G726_ENCODING_LINEAR, 16000, "g726_16"},
+    {CODEC_G726, G726_ENCODING_LINEAR, 24000, "g726_24"},
+    {CODEC_G726, G726_ENCODING_LINEAR, 32000, "g726_32"},
+    {CODEC_G726, G726_ENCODING_LINEAR, 40000, "g726_40"}
+};
+
+typedef struct
+{
+    codec_session_t enc;
+    codec_session_t dec;
+    snr_state_t snr;
+    /* Where in the source this channel starts, so channels do not all carry
+       the same audio. */
+    int offset;
+} bench_channel_t;
+
+typedef struct
+{
+    pthread_t thread;
+    pthread_barrier_t *barrier;
+    const int16_t *source;
+    int source_len;
+    bench_channel_t *channels;
+    int first;
+    int count;
+    int frames;
+    int out_fd;
+    double start;
+    double end;
+    uint32_t hist[HIST_BUCKETS];
+} bench_worker_t;
+
+typedef struct
+{
+    char name[16];
+    int channels;
+    int threads;
+    /* Channels' worth of audio processed per second of wall time. */
+    double realtime_channels;
+    double p50_us;
+    double p99_us;
+    double p999_us;
+    double snr_db;
+    int runs;
+    double run_p50_us[MAX_REPEATS];
+    double run_p99_us[MAX_REPEATS];
+    double run_p999_us[MAX_REPEATS];
+} bench_result_t;
+
+static bench_result_t results[MAX_RESULTS];
+static int result_count = 0;
+
+static double now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec*1.0e-9;
+}
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec*1000000000 + ts.tv_nsec;
+}
+
+static int hist_bucket(uint64_t ns)
+{
+    int octave;
+    int bucket;
+
+    if (ns < (1 << HIST_SUB_BITS))
+        return (int) ns;
+    octave = 63 - __builtin_clzll(ns);
+    bucket = ((octave - HIST_SUB_BITS + 1) << HIST_SUB_BITS) + (int) ((ns >> (octave - HIST_SUB_BITS)) & ((1 << HIST_SUB_BITS) - 1));
+    return (bucket < HIST_BUCKETS)  ?  bucket  :  HIST_BUCKETS - 1;
+}
+
+static double hist_bucket_upper_ns(int bucket)
+{
+    int octave;
+
+    if (bucket < (1 << HIST_SUB_BITS))
+        return bucket + 1;
+    octave = (bucket >> HIST_SUB_BITS) + HIST_SUB_BITS - 1;
+    return ldexp((double) ((1 << HIST_SUB_BITS) + (bucket & ((1 << HIST_SUB_BITS) - 1)) + 1), octave - HIST_SUB_BITS);
+}
+
+static double hist_percentile_us(const uint32_t hist[], uint64_t total, double fraction)
+{
+    uint64_t target;
+    uint64_t seen;
+    int i;
+
+    if (total*(1.0 - fraction) + 0.5 < MIN_TAIL_SAMPLES)
+        return NAN;
+    target = (uint64_t) ceil(total*fraction);
+    seen = 0;
+    for (i = 0;  i < HIST_BUCKETS;  i++)
+    {
+        seen += hist[i];
+        if (seen >= target)
+            return hist_bucket_upper_ns(i)/1000.0;
+    }
+    return hist_bucket_upper_ns(HIST_BUCKETS - 1)/1000.0;
+}
+
+static void *worker(void *arg)
+{
+    bench_worker_t *w;
+    bench_channel_t *ch;
+    codec_iov_t iov;
+    int16_t amp_out[BLOCK_LEN];
+    uint8_t g7xxdata[BLOCK_LEN];
+    const int16_t *amp;
+    uint64_t start;
+    int frame;
+    int i;
+    int pos;
+
+    w = (bench_worker_t *) arg;
+    pthread_barrier_wait(w->barrier);
+    w->start = now();
+    /* Every channel gets one frame per pass, as they would on a gateway tick. */
+    for (frame = 0;  frame < w->frames;  frame++)
+    {
+        for (i = 0;  i < w->count;  i++)
+        {
+            ch = &w->channels[w->first + i];
+            pos = (ch->offset + frame*BLOCK_LEN)%(w->source_len - BLOCK_LEN);
+            amp = &w->source[pos];
+            start = now_ns();
+            iov.session = &ch->enc;
+            iov.in = amp;
+            iov.in_len = BLOCK_LEN;
+            iov.out = g7xxdata;
+            codec_encode_batch(&iov, 1);
+            iov.session = &ch->dec;
+            iov.in = g7xxdata;
+            iov.in_len = iov.out_len;
+            iov.out = amp_out;
+            codec_decode_batch(&iov, 1);
+            snr_update(&ch->snr, amp, amp_out, iov.out_len);
+            if (write(w->out_fd, amp_out, iov.out_len*sizeof(amp_out[0])) < 0)
+            {
+                fprintf(stderr, "    Error writing output\n");
+                exit(2);
+            }
+            w->hist[hist_bucket(now_ns() - start)]++;
+        }
+    }
+    w->end = now();
+    return NULL;
+}
+
+static int compare_doubles(const void *a, const void *b)
+{
+    double x;
+    double y;
+
+    x = *(const double *) a;
+    y = *(const double *) b;
+    return (x > y) - (x < y);
+}
+
+static double median(double x[], int n)
+{
+    /* A percentile with too few samples is missing from every run alike. */
+    if (isnan(x[0]))
+        return NAN;
+    qsort(x, n, sizeof(x[0]), compare_doubles);
+    return (n & 1)  ?  x[n/2]  :  (x[n/2 - 1] + x[n/2])/2.0;
+}
+
+/* Run every channel through one measurement, returning the channels' worth
+   of audio processed per second, and filling in the latency histogram. */
+static double measure(bench_channel_t chans[], const int16_t source[], int source_len, int channels, int threads, int frames, uint32_t hist[])
+{
+    bench_worker_t *workers;
+    pthread_barrier_t barrier;
+    double start;
+    double end;
+    int per_thread;
+    int i;
+    int j;
+
+    if ((workers = (bench_worker_t *) calloc(threads, sizeof(*workers))) == NULL)
+    {
+        fprintf(stderr, "    Out of memory\n");
+        exit(2);
+    }
+    pthread_barrier_init(&barrier, NULL, threads + 1);
+    per_thread = channels/threads;
+    for (i = 0;  i < threads;  i++)
+    {
+        workers[i].barrier = &barrier;
+        workers[i].source = source;
+        workers[i].source_len = source_len;
+        workers[i].channels = chans;
+        workers[i].first = i*per_thread + ((i < channels%threads)  ?  i  :  channels%threads);
+        workers[i].count = per_thread + ((i < channels%threads)  ?  1  :  0);
+        workers[i].frames = frames;
+        if ((workers[i].out_fd = open("/dev/null", O_WRONLY)) < 0)
+        {
+            fprintf(stderr, "    Failed to open '/dev/null'\n");
+            exit(2);
+        }
+        pthread_create(&workers[i].thread, NULL, worker, &workers[i]);
+    }
+    pthread_barrier_wait(&barrier);
+    memset(hist, 0, sizeof(uint32_t)*HIST_BUCKETS);
+    start = HUGE_VAL;
+    end = 0.0;
+    for (i = 0;  i < threads;  i++)
+    {
+        pthread_join(workers[i].thread, NULL);
+        if (workers[i].start < start)
+            start = workers[i].start;
+        if (workers[i].end > end)
+            end = workers[i].end;
+        close(workers[i].out_fd);
+        for (j = 0;  j < HIST_BUCKETS;  j++)
+            hist[j] += workers[i].hist[j];
+    }
+    pthread_barrier_destroy(&barrier);
+    free(workers);
+    return (double) channels*frames*BLOCK_LEN/((end - start)*SAMPLE_RATE);
+}
+
+/* Measure one point of the sweep once, adding the run to its result. */
+static void run(int point, const bench_codec_t *codec, const int16_t source[], int source_len, int channels, int threads, int seconds)
+{
+    bench_channel_t *chans;
+    uint32_t hist[HIST_BUCKETS];
+    double realtime_channels;
+    bench_result_t *r;
+    uint64_t total;
+    int frames;
+    int i;
+
+    if (point >= MAX_RESULTS)
+        return;
+    frames = seconds*SAMPLE_RATE/BLOCK_LEN;
+    if (frames*channels < MIN_RUN_FRAMES)
+        frames = (MIN_RUN_FRAMES + channels - 1)/channels;
+    if ((chans = (bench_channel_t *) malloc(channels*sizeof(*chans))) == NULL)
+    {
+        fprintf(stderr, "    Out of memory\n");
+        exit(2);
+    }
+    for (i = 0;  i < channels;  i++)
+    {
+        codec_session_init(&chans[i].enc, codec->codec, codec->law, codec->bit_rate);
+        codec_session_init(&chans[i].dec, codec->codec, codec->law, codec->bit_rate);
+        snr_init(&chans[i].snr);
+        chans[i].offset = (int) ((int64_t) i*7919*BLOCK_LEN%(source_len - BLOCK_LEN));
+    }
+
+    r = &results[point];
+    if (point >= result_count)
+    {
+        memset(r, 0, sizeof(*r));
+        snprintf(r->name, sizeof(r->name), "%s", codec->name);
+        r->channels = channels;
+        r->threads = threads;
+        result_count = point + 1;
+    }
+    realtime_channels = measure(chans, source, source_len, channels, threads, frames, hist);
+    if (realtime_channels > r->realtime_channels)
+        r->realtime_channels = realtime_channels;
+    total = (uint64_t) channels*frames;
+    r->run_p50_us[r->runs] = hist_percentile_us(hist, total, 0.50);
+    r->run_p99_us[r->runs] = hist_percentile_us(hist, total, 0.99);
+    r->run_p999_us[r->runs] = hist_percentile_us(hist, total, 0.999);
+    r->runs++;
+    r->snr_db = snr_current_db(&chans[0].snr);
+    free(chans);
+}
+
+/* Reduce the runs of each point to its result, and list them. */
+static void report_results(void)
+{
+    bench_result_t *r;
+    int i;
+
+    printf("%-8s %8s %7s %14s %10s %10s %10s %8s\n", "codec", "channels", "threads", "realtime chans", "p50 us", "p99 us", "p99.9 us", "SNR");
+    for (i = 0;  i < result_count;  i++)
+    {
+        r = &results[i];
+        r->p50_us = median(r->run_p50_us, r->runs);
+        r->p99_us = median(r->run_p99_us, r->runs);
+        r->p999_us = median(r->run_p999_us, r->runs);
+        printf("%-8s %8d %7d %14.0f %10.2f %10.2f %10.2f %8.2f\n",
+               r->name,
+               r->channels,
+               r->threads,
+               r->realtime_channels,
+               r->p50_us,
+               r->p99_us,
+               r->p999_us,
+               r->snr_db);
+    }
+}
+
+/* Percentiles with too few samples behind them are written as null. */
+static void write_percentile(FILE *f, const char *key, double us)
+{
+    if (isnan(us))
+        fprintf(f, ", \"%s\": null", key);
+    else
+        fprintf(f, ", \"%s\": %.3f", key, us);
+}
+
+static void write_results(const char *name)
+{
+    FILE *f;
+    int i;
+
+    if ((f = fopen(name, "w")) == NULL)
+    {
+        fprintf(stderr, "    Cannot create '%s'\n", name);
+        exit(2);
+    }
+    fprintf(f, "{\n  \"results\": [\n");
+    for (i = 0;  i < result_count;  i++)
+    {
+        fprintf(f,
+                "    {\"codec\": \"%s\", \"channels\": %d, \"threads\": %d, \"realtime_channels\": %.1f",
+                results[i].name,
+                results[i].channels,
+                results[i].threads,
+                results[i].realtime_channels);
+        write_percentile(f, "p50_us", results[i].p50_us);
+        write_percentile(f, "p99_us", results[i].p99_us);
+        write_percentile(f, "p999_us", results[i].p999_us);
+        fprintf(f, "}%s\n", (i < result_count - 1)  ?  ","  :  "");
+    }
+    fprintf(f, "  ]\n}\n");
+    fclose(f);
+}
+
+static const char *json_field(const char *line, const char *key)
+{
+    char pattern[32];
+    const char *s;
+
+    snprintf(pattern, sizeof(pattern), "\"%s\"", key);
+    if ((s = strstr(line, pattern)) == NULL)
+        return NULL;
+    s += strlen(pattern);
+    while (*s == ' '  ||  *s == '\t'  ||  *s == ':'  ||  *s == '"')
+        s++;
+    return s;
+}
+
+/* The baseline is a file written by write_results(), with one result per
+   line. Results with no counterpart in the baseline are not compared, nor
+   are percentiles which either side had too few samples to report. */
+static int compare_results(const char *name, double threshold)
+{
+    FILE *f;
+    char line[512];
+    char codec[16];
+    const char *s[5];
+    int channels;
+    int threads;
+    double realtime_channels;
+    double p99_us;
+    int regressions;
+    int compared;
+    int i;
+
+    if ((f = fopen(name, "r")) == NULL)
+    {
+        printf("Cannot open baseline '%s'. Record one with -w on the reference machine.\n", name);
+        printf("Tests failed\n");
+        exit(2);
+    }
+    regressions = 0;
+    compared = 0;
+    while (fgets(line, sizeof(line), f))
+    {
+        if ((s[0] = json_field(line, "codec")) == NULL
+            ||
+            (s[1] = json_field(line, "channels")) == NULL
+            ||
+            (s[2] = json_field(line, "threads")) == NULL
+            ||
+            (s[3] = json_field(line, "realtime_channels")) == NULL
+            ||
+            (s[4] = json_field(line, "p99_us")) == NULL)
+        {
+            continue;
+        }
+        sscanf(s[0], "%15[^\"]", codec);
+        channels = atoi(s[1]);
+        threads = atoi(s[2]);
+        realtime_channels = atof(s[3]);
+        /* A null percentile had too few samples to compare. */
+        p99_us = (strncmp(s[4], "null", 4) == 0)  ?  NAN  :  atof(s[4]);
+        for (i = 0;  i < result_count;  i++)
+        {
+            if (strcmp(results[i].name, codec) == 0  &&  results[i].channels == channels  &&  results[i].threads == threads)
+                break;
+        }
+        if (i >= result_count)
+            continue;
+        compared++;
+        if (results[i].realtime_channels < realtime_channels*(1.0 - threshold))
+        {
+            printf("%s, %d channels, %d threads: throughput %.0f is below the baseline %.0f\n",
+                   codec, channels, threads, results[i].realtime_channels, realtime_channels);
+            regressions++;
+        }
+        if (!isnan(p99_us)  &&  !isnan(results[i].p99_us)  &&  results[i].p99_us > p99_us*(1.0 + threshold))
+        {
+            printf("%s, %d channels, %d threads: p99 latency %.2fus is above the baseline %.2fus\n",
+                   codec, channels, threads, results[i].p99_us, p99_us);
+            regressions++;
+        }
+    }
+    fclose(f);
+    /* A baseline which matches nothing would pass every run. */
+    if (compared == 0)
+    {
+        printf("Baseline '%s' has no results for the channel and thread counts measured\n", name);
+        printf("Tests failed\n");
+        exit(2);
+    }
+    printf("Compared %d results against '%s'\n", compared, name);
+    return regressions;
+}
+
+static int16_t *load_source(const char *name, int *len)
+{
+    SNDFILE *inhandle;
+    int16_t *amp;
+    int size;
+    int frames;
+
+    if ((inhandle = sf_open_telephony_read(name, 1)) == NULL)
+    {
+        fprintf(stderr, "    Cannot open audio file '%s'\n", name);
+        exit(2);
+    }
+    size = 0;
+    *len = 0;
+    amp = NULL;
+    do
+    {
+        if (*len + BLOCK_LEN > size)
+        {
+            size = (size)  ?  2*size  :  65536;
+            if ((amp = (int16_t *) realloc(amp, size*sizeof(amp[0]))) == NULL)
+            {
+                fprintf(stderr, "    Out of memory\n");
+                exit(2);
+            }
+        }
+        frames = sf_readf_short(inhandle, &amp[*len], BLOCK_LEN);
+        if (frames > 0)
+            *len += frames;
+    }
+    while (frames > 0);
+    if (sf_close_telephony(inhandle))
+    {
+        fprintf(stderr, "    Cannot close audio file '%s'\n", name);
+        exit(2);
+    }
+    if (*len <= BLOCK_LEN)
+    {
+        fprintf(stderr, "    Audio file '%s' is too short\n", name);
+        exit(2);
+    }
+    return amp;
+}
+
+static void usage(void)
+{
+    printf("Usage: G7xx_bench [-c max channels] [-p max threads] [-s seconds] [-r repeats] [-w results.json] [-b baseline.json] [-t threshold %%]\n");
+}
+
+int main(int argc, char *argv[])
+{
+    int16_t *source;
+    int source_len;
+    int opt;
+    int max_channels;
+    int max_threads;
+    int seconds;
+    int repeats;
+    int point;
+    int channels;
+    int threads;
+    double threshold;
+    const char *baseline_file;
+    const char *results_file;
+    int i;
+    int j;
+
+    max_channels = 256;
+    max_threads = (int) sysconf(_SC_NPROCESSORS_ONLN);
+    seconds = 2;
+    repeats = DEFAULT_REPEATS;
+    threshold = 10.0;
+    baseline_file = NULL;
+    results_file = NULL;
+    while ((opt = getopt(argc, argv, "b:c:hp:r:s:t:w:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'b':
+            baseline_file = optarg;
+            break;
+        case 'c':
+            max_channels = atoi(optarg);
+            break;
+        case 'p':
+            max_threads = atoi(optarg);
+            break;
+        case 'r':
+            repeats = atoi(optarg);
+            break;
+        case 's':
+            seconds = atoi(optarg);
+            break;
+        case 't':
+            threshold = atof(optarg);
+            break;
+        case 'w':
+            results_file = optarg;
+            break;
+        default:
+            usage();
+            exit(2);
+        }
+    }
+    if (max_channels < 1  ||  max_threads < 1  ||  seconds < 1  ||  repeats < 1  ||  repeats > MAX_REPEATS)
+    {
+        usage();
+        exit(2);
+    }
+
+    source = load_source(IN_FILE_NAME, &source_len);
+    printf("Replaying '%s' for at least %ds per channel, best or median of %d runs\n", IN_FILE_NAME, seconds, repeats);
+    for (j = 0;  j < repeats;  j++)
+    {
+        point = 0;
+        for (i = 0;  i < (int) (sizeof(codecs)/sizeof(codecs[0]));  i++)
+        {
+            for (channels = 1;  ;  channels *= 2)
+            {
+                if (channels > max_channels)
+                    channels = max_channels;
+                for (threads = 1;  ;  threads *= 2)
+                {
+                    if (threads > max_threads)
+                        threads = max_threads;
+                    if (threads > channels)
+                        break;
+                    run(point++, &codecs[i], source, source_len, channels, threads, seconds);
+                    if (threads == max_threads)
+                        break;
+                }
+                if (channels == max_channels)
+                    break;
+            }
+        }
+    }
+    report_results();
+    free(source);
+
+    if (results_file)
+        write_results(results_file);
+    if (baseline_file)
+    {
+        if (compare_results(baseline_file, threshold/100.0))
+        {
+            printf("Performance regressed by more than %.1f%% against '%s'\n", threshold, baseline_file);
+            printf("Tests failed\n");
+            exit(2);
+        }
+        printf("No regressions beyond %.1f%% against '%s'\n", threshold, baseline_file);
+    }
+    return 0;
+}
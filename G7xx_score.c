@@ -0,0 +1,599 @@
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <time.h>
+#include <math.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#define SEGMENT_LEN         160
+/* Segmental SNR limits, in dB, so silence and overload do not dominate. */
+#define SEGSNR_MIN          -10.0
+#define SEGSNR_MAX          35.0
+/* How much of the signal is used to find the codec delay. */
+#define ALIGN_WINDOW        (8000*4)
+#define DEFAULT_MAX_DELAY   160
+
+#define REF_FILE_NAME       "male.wav"
+
+static const char *default_decoded[] =
+{
+    "male_g711.wav",
+    "male_output_g711.wav",
+    "male_g726_16.wav",
+    "male_g726_24.wav",
+    "male_g726_32.wav",
+    "male_g726_40.wav"
+};
+
+typedef struct
+{
+    const uint8_t *map;
+    size_t map_len;
+    const int16_t *amp;
+    int len;
+} wav_map_t;
+
+typedef struct
+{
+    char *ref_name;
+    char *dec_name;
+    /* The coding rate in kbit/s, or 0 if not known. */
+    int rate;
+    int ok;
+    int delay;
+    int samples;
+    double snr;
+    double segsnr;
+    int max_err;
+} score_job_t;
+
+typedef struct
+{
+    score_job_t *jobs;
+    int count;
+    int next;
+    int max_delay;
+    pthread_mutex_t lock;
+} score_queue_t;
+
+static uint32_t get_le32(const uint8_t *p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t) p[3] << 24);
+}
+
+static uint16_t get_le16(const uint8_t *p)
+{
+    return (uint16_t) (p[0] | (p[1] << 8));
+}
+
+/* Map a 16 bit mono PCM WAV file, and find its samples. The samples are used
+   in place, which assumes a little endian host. */
+static int wav_map(wav_map_t *w, const char *name)
+{
+    struct stat st;
+    const uint8_t *p;
+    const uint8_t *end;
+    uint32_t chunk_len;
+    int fd;
+    int have_fmt;
+
+    memset(w, 0, sizeof(*w));
+    if ((fd = open(name, O_RDONLY)) < 0)
+        return -1;
+    if (fstat(fd, &st) < 0  ||  st.st_size < 12)
+    {
+        close(fd);
+        return -1;
+    }
+    w->map_len = st.st_size;
+    w->map = (const uint8_t *) mmap(NULL, w->map_len, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (w->map == MAP_FAILED)
+    {
+        w->map = NULL;
+        return -1;
+    }
+    madvise((void *) w->map, w->map_len, MADV_SEQUENTIAL);
+    if (memcmp(w->map, "RIFF", 4)  ||  memcmp(w->map + 8, "WAVE", 4))
+        return -1;
+    end = w->map + w->map_len;
+    have_fmt = false;
+    for (p = w->map + 12;  p + 8 <= end;  p += 8 + chunk_len + (chunk_len & 1))
+    {
+        chunk_len = get_le32(p + 4);
+        if (memcmp(p, "fmt ", 4) == 0)
+        {
+            if (chunk_len < 16  ||  p + 8 + 16 > end)
+                return -1;
+            /* PCM, or WAVE_FORMAT_EXTENSIBLE wrapping PCM. */
+            if ((get_le16(p + 8) != 1  &&  get_le16(p + 8) != 0xFFFE)
+                ||
+                get_le16(p + 10) != 1
+                ||
+                get_le16(p + 22) != 16)
+            {
+                return -1;
+            }
+            have_fmt = true;
+        }
+        else if (memcmp(p, "data", 4) == 0)
+        {
+            if (!have_fmt)
+                return -1;
+            /* Tolerate a data length left unset, or longer than the file. */
+            if (chunk_len > (uint32_t) (end - (p + 8)))
+                chunk_len = (uint32_t) (end - (p + 8));
+            w->amp = (const int16_t *) (p + 8);
+            w->len = chunk_len/2;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+static void wav_unmap(wav_map_t *w)
+{
+    if (w->map)
+        munmap((void *) w->map, w->map_len);
+    w->map = NULL;
+}
+
+/* Cross correlation of a with b, and the energy of b, over len samples. The
+   inputs are halved first, so the 16 bit multiplies cannot overflow. */
+static void correlate(const int16_t a[], const int16_t b[], int len, int64_t *xcorr, int64_t *energy)
+{
+    int64_t xc;
+    int64_t en;
+    int i;
+
+    xc = 0;
+    en = 0;
+    i = 0;
+#if defined(__SSE2__)
+    {
+        __m128i x;
+        __m128i y;
+        __m128i xc4;
+        __m128i en4;
+        int32_t lanes[4];
+        int j;
+
+        /* Each 32 bit lane gains at most 2*2^28 per step, so flush to 64 bits
+           every 2 steps. */
+        while (i + 8 <= len)
+        {
+            xc4 = _mm_setzero_si128();
+            en4 = _mm_setzero_si128();
+            for (j = 0;  j < 2  &&  i + 8 <= len;  j++, i += 8)
+            {
+                x = _mm_srai_epi16(_mm_loadu_si128((const __m128i *) &a[i]), 1);
+                y = _mm_srai_epi16(_mm_loadu_si128((const __m128i *) &b[i]), 1);
+                xc4 = _mm_add_epi32(xc4, _mm_madd_epi16(x, y));
+                en4 = _mm_add_epi32(en4, _mm_madd_epi16(y, y));
+            }
+            _mm_storeu_si128((__m128i *) lanes, xc4);
+            xc += (int64_t) lanes[0] + lanes[1] + lanes[2] + lanes[3];
+            _mm_storeu_si128((__m128i *) lanes, en4);
+            en += (int64_t) lanes[0] + lanes[1] + lanes[2] + lanes[3];
+        }
+    }
+#endif
+    for (  ;  i < len;  i++)
+    {
+        xc += (int64_t) (a[i] >> 1)*(b[i] >> 1);
+        en += (int64_t) (b[i] >> 1)*(b[i] >> 1);
+    }
+    *xcorr = xc;
+    *energy = en;
+}
+
+/* Signal energy, error energy and peak absolute error over one segment. */
+static void segment_stats(const int16_t ref[], const int16_t dec[], int len, uint64_t *signal, uint64_t *error, int *max_err)
+{
+    uint64_t sig;
+    uint64_t err;
+    int peak;
+    int d;
+    int i;
+
+    sig = 0;
+    err = 0;
+    peak = 0;
+    i = 0;
+#if defined(__SSE2__)
+    {
+        __m128i zero;
+        __m128i r;
+        __m128i e;
+        __m128i s;
+        __m128i ref32[2];
+        __m128i dec32[2];
+        __m128i sig2;
+        __m128i err2;
+        __m128i peak4;
+        __m128i gt;
+        uint64_t q[2];
+        int32_t lanes[4];
+        int k;
+
+        zero = _mm_setzero_si128();
+        sig2 = zero;
+        err2 = zero;
+        peak4 = zero;
+        for (  ;  i + 8 <= len;  i += 8)
+        {
+            r = _mm_loadu_si128((const __m128i *) &ref[i]);
+            e = _mm_loadu_si128((const __m128i *) &dec[i]);
+            s = _mm_srai_epi16(r, 15);
+            ref32[0] = _mm_unpacklo_epi16(r, s);
+            ref32[1] = _mm_unpackhi_epi16(r, s);
+            s = _mm_srai_epi16(e, 15);
+            dec32[0] = _mm_unpacklo_epi16(e, s);
+            dec32[1] = _mm_unpackhi_epi16(e, s);
+            for (k = 0;  k < 2;  k++)
+            {
+                /* |x| fits 17 bits, so its square fits the unsigned 32x32->64
+                   multiply exactly. */
+                s = _mm_srai_epi32(ref32[k], 31);
+                r = _mm_sub_epi32(_mm_xor_si128(ref32[k], s), s);
+                sig2 = _mm_add_epi64(sig2, _mm_mul_epu32(r, r));
+                r = _mm_srli_epi64(r, 32);
+                sig2 = _mm_add_epi64(sig2, _mm_mul_epu32(r, r));
+
+                e = _mm_sub_epi32(ref32[k], dec32[k]);
+                s = _mm_srai_epi32(e, 31);
+                e = _mm_sub_epi32(_mm_xor_si128(e, s), s);
+                gt = _mm_cmpgt_epi32(e, peak4);
+                peak4 = _mm_or_si128(_mm_and_si128(gt, e), _mm_andnot_si128(gt, peak4));
+                err2 = _mm_add_epi64(err2, _mm_mul_epu32(e, e));
+                e = _mm_srli_epi64(e, 32);
+                err2 = _mm_add_epi64(err2, _mm_mul_epu32(e, e));
+            }
+        }
+        _mm_storeu_si128((__m128i *) q, sig2);
+        sig = q[0] + q[1];
+        _mm_storeu_si128((__m128i *) q, err2);
+        err = q[0] + q[1];
+        _mm_storeu_si128((__m128i *) lanes, peak4);
+        for (k = 0;  k < 4;  k++)
+        {
+            if (lanes[k] > peak)
+                peak = lanes[k];
+        }
+    }
+#endif
+    for (  ;  i < len;  i++)
+    {
+        d = ref[i] - dec[i];
+        sig += (int64_t) ref[i]*ref[i];
+        err += (int64_t) d*d;
+        if (abs(d) > peak)
+            peak = abs(d);
+    }
+    *signal = sig;
+    *error = err;
+    *max_err = peak;
+}
+
+/* Find the delay of dec relative to ref, in [0, max_delay], which best lines
+   the two up. */
+static int find_delay(const int16_t ref[], int ref_len, const int16_t dec[], int dec_len, int max_delay)
+{
+    int64_t xcorr;
+    int64_t energy;
+    double score;
+    double best_score;
+    int best;
+    int delay;
+    int len;
+
+    best = 0;
+    best_score = -HUGE_VAL;
+    for (delay = 0;  delay <= max_delay;  delay++)
+    {
+        len = (ref_len < dec_len - delay)  ?  ref_len  :  dec_len - delay;
+        if (len > ALIGN_WINDOW)
+            len = ALIGN_WINDOW;
+        if (len <= 0)
+            break;
+        correlate(ref, &dec[delay], len, &xcorr, &energy);
+        if (energy <= 0)
+            continue;
+        score = (double) xcorr/sqrt((double) energy);
+        if (score > best_score)
+        {
+            best_score = score;
+            best = delay;
+        }
+    }
+    return best;
+}
+
+static void score(score_job_t *job, int max_delay)
+{
+    wav_map_t ref;
+    wav_map_t dec;
+    uint64_t sig_total;
+    uint64_t err_total;
+    uint64_t sig;
+    uint64_t err;
+    double segsnr_sum;
+    double seg;
+    int segments;
+    int peak;
+    int len;
+    int i;
+    int n;
+
+    job->ok = false;
+    memset(&ref, 0, sizeof(ref));
+    memset(&dec, 0, sizeof(dec));
+    if (wav_map(&ref, job->ref_name)  ||  wav_map(&dec, job->dec_name))
+    {
+        wav_unmap(&ref);
+        wav_unmap(&dec);
+        return;
+    }
+    job->delay = find_delay(ref.amp, ref.len, dec.amp, dec.len, max_delay);
+    len = (ref.len < dec.len - job->delay)  ?  ref.len  :  dec.len - job->delay;
+    sig_total = 0;
+    err_total = 0;
+    segsnr_sum = 0.0;
+    segments = 0;
+    job->max_err = 0;
+    for (i = 0;  i < len;  i += SEGMENT_LEN)
+    {
+        n = (len - i < SEGMENT_LEN)  ?  len - i  :  SEGMENT_LEN;
+        segment_stats(&ref.amp[i], &dec.amp[i + job->delay], n, &sig, &err, &peak);
+        sig_total += sig;
+        err_total += err;
+        if (peak > job->max_err)
+            job->max_err = peak;
+        /* Digital silence on both sides says nothing about quality. */
+        if (sig == 0  &&  err == 0)
+            continue;
+        if (err == 0)
+            seg = SEGSNR_MAX;
+        else if (sig == 0)
+            seg = SEGSNR_MIN;
+        else
+            seg = 10.0*log10((double) sig/err);
+        if (seg > SEGSNR_MAX)
+            seg = SEGSNR_MAX;
+        else if (seg < SEGSNR_MIN)
+            seg = SEGSNR_MIN;
+        segsnr_sum += seg;
+        segments++;
+    }
+    job->samples = (len > 0)  ?  len  :  0;
+    job->snr = (err_total)  ?  10.0*log10((double) sig_total/err_total)  :  HUGE_VAL;
+    job->segsnr = (segments)  ?  segsnr_sum/segments  :  0.0;
+    job->ok = true;
+    wav_unmap(&ref);
+    wav_unmap(&dec);
+}
+
+static void *worker(void *arg)
+{
+    score_queue_t *q;
+    int i;
+
+    q = (score_queue_t *) arg;
+    for (;;)
+    {
+        pthread_mutex_lock(&q->lock);
+        i = q->next++;
+        pthread_mutex_unlock(&q->lock);
+        if (i >= q->count)
+            break;
+        score(&q->jobs[i], q->max_delay);
+    }
+    return NULL;
+}
+
+/* Guess the coding rate from names like male_g726_24.wav or male_g711.wav. */
+static int rate_from_name(const char *name)
+{
+    const char *s;
+
+    if ((s = strstr(name, "g726_")))
+        return atoi(s + 5);
+    if (strstr(name, "g711"))
+        return 64;
+    return 0;
+}
+
+static int compare_jobs(const void *a, const void *b)
+{
+    const score_job_t *x;
+    const score_job_t *y;
+
+    x = (const score_job_t *) a;
+    y = (const score_job_t *) b;
+    if (x->rate != y->rate)
+        return (x->rate > y->rate) - (x->rate < y->rate);
+    return strcmp(x->dec_name, y->dec_name);
+}
+
+static void add_job(score_job_t **jobs, int *count, int *size, const char *ref_name, const char *dec_name, int rate)
+{
+    if (*count >= *size)
+    {
+        *size = (*size)  ?  2*(*size)  :  64;
+        if ((*jobs = (score_job_t *) realloc(*jobs, *size*sizeof(**jobs))) == NULL)
+        {
+            fprintf(stderr, "    Out of memory\n");
+            exit(2);
+        }
+    }
+    memset(&(*jobs)[*count], 0, sizeof(**jobs));
+    (*jobs)[*count].ref_name = strdup(ref_name);
+    (*jobs)[*count].dec_name = strdup(dec_name);
+    (*jobs)[*count].rate = (rate > 0)  ?  rate  :  rate_from_name(dec_name);
+    (*count)++;
+}
+
+/* Each line of a list file is "reference decoded [rate in kbit/s]". */
+static void read_list(const char *name, score_job_t **jobs, int *count, int *size)
+{
+    FILE *f;
+    char line[2048];
+    char ref_name[1024];
+    char dec_name[1024];
+    int rate;
+    int n;
+
+    if ((f = fopen(name, "r")) == NULL)
+    {
+        fprintf(stderr, "    Cannot open list '%s'\n", name);
+        exit(2);
+    }
+    while (fgets(line, sizeof(line), f))
+    {
+        rate = 0;
+        n = sscanf(line, "%1023s %1023s %d", ref_name, dec_name, &rate);
+        if (n < 2  ||  ref_name[0] == '#')
+            continue;
+        add_job(jobs, count, size, ref_name, dec_name, rate);
+    }
+    fclose(f);
+}
+
+static void usage(void)
+{
+    printf("Usage: G7xx_score [-r reference.wav] [-l list] [-d max delay] [-p threads] [decoded.wav ...]\n");
+}
+
+int main(int argc, char *argv[])
+{
+    score_queue_t queue;
+    score_job_t *jobs;
+    pthread_t *threads;
+    const char *ref_name;
+    const char *list_name;
+    struct timespec start;
+    struct timespec end;
+    double elapsed;
+    int64_t total_samples;
+    int job_count;
+    int job_size;
+    int thread_count;
+    int max_delay;
+    int failures;
+    int opt;
+    int i;
+
+    ref_name = REF_FILE_NAME;
+    list_name = NULL;
+    max_delay = DEFAULT_MAX_DELAY;
+    thread_count = (int) sysconf(_SC_NPROCESSORS_ONLN);
+    while ((opt = getopt(argc, argv, "d:hl:p:r:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'd':
+            max_delay = atoi(optarg);
+            break;
+        case 'l':
+            list_name = optarg;
+            break;
+        case 'p':
+            thread_count = atoi(optarg);
+            break;
+        case 'r':
+            ref_name = optarg;
+            break;
+        default:
+            usage();
+            exit(2);
+        }
+    }
+    if (max_delay < 0  ||  thread_count < 1)
+    {
+        usage();
+        exit(2);
+    }
+
+    jobs = NULL;
+    job_count = 0;
+    job_size = 0;
+    if (list_name)
+        read_list(list_name, &jobs, &job_count, &job_size);
+    for (i = optind;  i < argc;  i++)
+        add_job(&jobs, &job_count, &job_size, ref_name, argv[i], 0);
+    if (job_count == 0)
+    {
+        for (i = 0;  i < (int) (sizeof(default_decoded)/sizeof(default_decoded[0]));  i++)
+            add_job(&jobs, &job_count, &job_size, ref_name, default_decoded[i], 0);
+    }
+    if (thread_count > job_count)
+        thread_count = job_count;
+
+    queue.jobs = jobs;
+    queue.count = job_count;
+    queue.next = 0;
+    queue.max_delay = max_delay;
+    pthread_mutex_init(&queue.lock, NULL);
+    if ((threads = (pthread_t *) malloc(thread_count*sizeof(*threads))) == NULL)
+    {
+        fprintf(stderr, "    Out of memory\n");
+        exit(2);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (i = 0;  i < thread_count;  i++)
+        pthread_create(&threads[i], NULL, worker, &queue);
+    for (i = 0;  i < thread_count;  i++)
+        pthread_join(threads[i], NULL);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    elapsed = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec)*1.0e-9;
+    pthread_mutex_destroy(&queue.lock);
+    free(threads);
+
+    qsort(jobs, job_count, sizeof(jobs[0]), compare_jobs);
+    printf("%8s %7s %10s %10s %8s  %s\n", "kbit/s", "delay", "SNR", "segSNR", "max err", "decoded");
+    failures = 0;
+    total_samples = 0;
+    for (i = 0;  i < job_count;  i++)
+    {
+        if (!jobs[i].ok)
+        {
+            printf("%8s %7s %10s %10s %8s  %s (cannot read '%s' or '%s' as 16 bit mono WAV)\n",
+                   "-", "-", "-", "-", "-", jobs[i].dec_name, jobs[i].ref_name, jobs[i].dec_name);
+            failures++;
+        }
+        else
+        {
+            if (jobs[i].rate)
+                printf("%8d ", jobs[i].rate);
+            else
+                printf("%8s ", "?");
+            printf("%7d %10.3f %10.3f %8d  %s\n",
+                   jobs[i].delay,
+                   jobs[i].snr,
+                   jobs[i].segsnr,
+                   jobs[i].max_err,
+                   jobs[i].dec_name);
+            total_samples += jobs[i].samples;
+        }
+        free(jobs[i].ref_name);
+        free(jobs[i].dec_name);
+    }
+    printf("Scored %d of %d files, %lld samples, in %.3fs using %d threads (%.1f Msamples/s)\n",
+           job_count - failures,
+           job_count,
+           (long long) total_samples,
+           elapsed,
+           thread_count,
+           (elapsed > 0.0)  ?  total_samples/(elapsed*1.0e6)  :  0.0);
+    free(jobs);
+    return (failures)  ?  2  :  0;
+}
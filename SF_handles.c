@@ -0,0 +1,274 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <string.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <sys/resource.h>
+#include <sndfile.h>
+#include <spandsp.h>
+
+#include </usr/include/spandsp/test_utils.h>
+
+#include "sf_telephony.h"
+
+#define IN_FILE_NAME        "male.wav"
+
+#define THREADS             8
+#define HANDLES_PER_THREAD  100
+#define CHURN_ROUNDS        20
+
+/* Addresses which are never dereferenced, registered to check how the
+   registry spreads handles allocated at page multiple strides. */
+#define FAKE_HANDLES        4000
+#define FAKE_HANDLE_BASE    0x40000000
+/* Handles sharing one home slot per shard would give probes of ~60. */
+#define MAX_PROBE           16
+
+typedef struct
+{
+    pthread_t thread;
+    unsigned int seed;
+    SNDFILE *handles[HANDLES_PER_THREAD];
+    int order[HANDLES_PER_THREAD];
+} handle_worker_t;
+
+static pthread_barrier_t barrier;
+
+static int base_fds;
+
+/* Set when a test fails, so the exit handler does not report a pass. */
+static int failed = 0;
+
+static void tests_failed(void)
+{
+    failed = 1;
+    printf("Tests failed\n");
+    exit(2);
+}
+
+static int count_open_fds(void)
+{
+    DIR *dir;
+    struct dirent *entry;
+    int n;
+
+    if ((dir = opendir("/proc/self/fd")) == NULL)
+        return -1;
+    n = 0;
+    while ((entry = readdir(dir)))
+    {
+        if (entry->d_name[0] != '.')
+            n++;
+    }
+    closedir(dir);
+    /* Don't count the descriptor used to read the directory. */
+    return n - 1;
+}
+
+static void shuffle(handle_worker_t *w)
+{
+    int i;
+    int j;
+    int tmp;
+
+    for (i = 0;  i < HANDLES_PER_THREAD;  i++)
+        w->order[i] = i;
+    for (i = HANDLES_PER_THREAD - 1;  i > 0;  i--)
+    {
+        j = rand_r(&w->seed)%(i + 1);
+        tmp = w->order[i];
+        w->order[i] = w->order[j];
+        w->order[j] = tmp;
+    }
+}
+
+static void open_missing(handle_worker_t *w)
+{
+    int i;
+
+    for (i = 0;  i < HANDLES_PER_THREAD;  i++)
+    {
+        if (w->handles[i] == NULL)
+            w->handles[i] = sf_open_telephony_read(IN_FILE_NAME, 1);
+    }
+}
+
+/* Close the first half of the handles, in a random order. */
+static void close_half(handle_worker_t *w)
+{
+    int i;
+    int k;
+
+    shuffle(w);
+    for (i = 0;  i < HANDLES_PER_THREAD/2;  i++)
+    {
+        k = w->order[i];
+        if (w->handles[k]  &&  sf_close_telephony(w->handles[k]))
+        {
+            fprintf(stderr, "    Cannot close audio file '%s'\n", IN_FILE_NAME);
+            failed = 1;
+            exit(2);
+        }
+        w->handles[k] = NULL;
+    }
+}
+
+static void *worker(void *arg)
+{
+    handle_worker_t *w;
+    int i;
+
+    w = (handle_worker_t *) arg;
+
+    open_missing(w);
+    pthread_barrier_wait(&barrier);
+    pthread_barrier_wait(&barrier);
+
+    close_half(w);
+    pthread_barrier_wait(&barrier);
+    pthread_barrier_wait(&barrier);
+
+    /* Churn, so shards grow and entries are removed from the middle of
+       probe runs. */
+    for (i = 0;  i < CHURN_ROUNDS;  i++)
+    {
+        open_missing(w);
+        close_half(w);
+    }
+    pthread_barrier_wait(&barrier);
+    pthread_barrier_wait(&barrier);
+    /* The rest are left open for the exit handler to close. */
+    return NULL;
+}
+
+static void check_open(const char *phase, int expected)
+{
+    int n;
+
+    printf("%s: %d handles open.\n", phase, n = sf_telephony_open_handles());
+    if (n != expected)
+    {
+        printf("Expected %d open handles\n", expected);
+        tests_failed();
+    }
+}
+
+static SNDFILE *fake_handle(int i, uintptr_t stride)
+{
+    return (SNDFILE *) (FAKE_HANDLE_BASE + i*stride);
+}
+
+static void page_aligned_tests(void)
+{
+    static const uintptr_t strides[] = {4096, 8192, 12288, 16384, 65536};
+    int registered;
+    int forgotten;
+    int open;
+    int probe;
+    int i;
+    int n;
+
+    for (n = 0;  n < (int) (sizeof(strides)/sizeof(strides[0]));  n++)
+    {
+        for (registered = 0;  registered < FAKE_HANDLES;  registered++)
+        {
+            if (sf_telephony_record_handle(fake_handle(registered, strides[n])))
+                break;
+        }
+        probe = sf_telephony_max_probe();
+        open = sf_telephony_open_handles();
+        /* Forget them from the middle out, so entries are removed from inside
+           probe runs. Do this before checking anything, as the fake handles
+           must not be left for the exit handler to close. */
+        forgotten = 0;
+        for (i = 0;  i < registered;  i++)
+        {
+            if (sf_telephony_forget_handle(fake_handle((i + registered/2)%registered, strides[n])) == 0)
+                forgotten++;
+        }
+        printf("%d handles at a stride of %lu bytes: longest probe %d.\n", registered, (unsigned long) strides[n], probe);
+        if (registered != FAKE_HANDLES  ||  open != FAKE_HANDLES  ||  forgotten != registered)
+        {
+            printf("Registered %d of %d handles, counted %d, forgot %d\n", registered, FAKE_HANDLES, open, forgotten);
+            tests_failed();
+        }
+        if (probe > MAX_PROBE)
+        {
+            printf("Expected no probe longer than %d\n", MAX_PROBE);
+            tests_failed();
+        }
+        check_open("Forgotten", 0);
+    }
+}
+
+/* Registered before any handle is opened, so it runs after the telephony
+   helpers' own exit handler has closed everything. */
+static void check_closed_at_exit(void)
+{
+    int fds;
+
+    if (failed)
+        return;
+    fds = count_open_fds();
+    if (sf_telephony_open_handles() != 0  ||  fds != base_fds)
+    {
+        printf("At exit: %d handles still registered, %d file descriptors open, expected %d\n",
+               sf_telephony_open_handles(), fds, base_fds);
+        printf("Tests failed\n");
+        fflush(stdout);
+        _exit(2);
+    }
+    printf("All handles closed at exit.\n");
+    printf("Tests passed.\n");
+}
+
+int main(int argc, char *argv[])
+{
+    handle_worker_t workers[THREADS];
+    struct rlimit lim;
+    int i;
+
+    /* Several hundred files stay open at once. */
+    if (getrlimit(RLIMIT_NOFILE, &lim) == 0  &&  lim.rlim_cur < lim.rlim_max)
+    {
+        lim.rlim_cur = lim.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &lim);
+    }
+    if ((base_fds = count_open_fds()) < 0)
+    {
+        fprintf(stderr, "    Cannot count open file descriptors\n");
+        exit(2);
+    }
+    atexit(check_closed_at_exit);
+
+    check_open("Start", 0);
+    page_aligned_tests();
+
+    printf("Opening and closing %d handles from %d threads.\n", THREADS*HANDLES_PER_THREAD, THREADS);
+    memset(workers, 0, sizeof(workers));
+    pthread_barrier_init(&barrier, NULL, THREADS + 1);
+    for (i = 0;  i < THREADS;  i++)
+    {
+        workers[i].seed = i + 1;
+        pthread_create(&workers[i].thread, NULL, worker, &workers[i]);
+    }
+
+    pthread_barrier_wait(&barrier);
+    check_open("All opened", THREADS*HANDLES_PER_THREAD);
+    pthread_barrier_wait(&barrier);
+
+    pthread_barrier_wait(&barrier);
+    check_open("Half closed", THREADS*(HANDLES_PER_THREAD - HANDLES_PER_THREAD/2));
+    pthread_barrier_wait(&barrier);
+
+    pthread_barrier_wait(&barrier);
+    check_open("After churn", THREADS*(HANDLES_PER_THREAD - HANDLES_PER_THREAD/2));
+    pthread_barrier_wait(&barrier);
+
+    for (i = 0;  i < THREADS;  i++)
+        pthread_join(workers[i].thread, NULL);
+    pthread_barrier_destroy(&barrier);
+    return 0;
+}
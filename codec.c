@@ -0,0 +1,129 @@
+/*
+ * codec.c - Batch G.711/G.726 codec sessions
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "codec.h"
+
+codec_session_t *codec_session_init(codec_session_t *s, int codec, int law, int bit_rate)
+{
+    codec_session_t *t;
+
+    switch (codec)
+    {
+    case CODEC_G711:
+        if ((law != G711_ALAW  &&  law != G711_ULAW)  ||  bit_rate != 64000)
+            return NULL;
+        break;
+    case CODEC_G726:
+        if (law != G726_ENCODING_LINEAR  &&  law != G726_ENCODING_ULAW  &&  law != G726_ENCODING_ALAW)
+            return NULL;
+        if (bit_rate != 16000  &&  bit_rate != 24000  &&  bit_rate != 32000  &&  bit_rate != 40000)
+            return NULL;
+        break;
+    default:
+        return NULL;
+    }
+    t = s;
+    if (t == NULL)
+    {
+        if ((t = (codec_session_t *) malloc(sizeof(*t))) == NULL)
+            return NULL;
+    }
+    memset(t, 0, sizeof(*t));
+    t->codec = codec;
+    t->law = law;
+    t->bit_rate = bit_rate;
+    if (codec == CODEC_G711)
+    {
+        g711_init(&t->state.g711, law);
+    }
+    else if (g726_init(&t->state.g726, bit_rate, law, G726_PACKING_NONE) == NULL)
+    {
+        if (s == NULL)
+            free(t);
+        return NULL;
+    }
+    return t;
+}
+
+int codec_session_release(codec_session_t *s)
+{
+    return 0;
+}
+
+int codec_session_free(codec_session_t *s)
+{
+    free(s);
+    return 0;
+}
+
+int codec_session_set_bit_rate(codec_session_t *s, int bit_rate)
+{
+    g726_state_t t;
+
+    if (s->codec == CODEC_G711)
+        return (bit_rate == 64000)  ?  0  :  -1;
+    if (bit_rate != 16000  &&  bit_rate != 24000  &&  bit_rate != 32000  &&  bit_rate != 40000)
+        return -1;
+    if (bit_rate == s->bit_rate)
+        return 0;
+    /* Initialising a state on the stack picks up the encoder and decoder
+       functions for the new rate without touching the heap. Only the rate
+       dependent fields are copied, so the predictor and scale factor
+       adaptation continue from where they were. */
+    g726_init(&t, bit_rate, s->law, s->state.g726.packing);
+    s->state.g726.rate = t.rate;
+    s->state.g726.bits_per_sample = t.bits_per_sample;
+    s->state.g726.enc_func = t.enc_func;
+    s->state.g726.dec_func = t.dec_func;
+    /* Any partly packed codeword belongs to the old rate. Take the fresh
+       bit packer from the new state, which was set up for the same packing. */
+    s->state.g726.bs = t.bs;
+    s->bit_rate = bit_rate;
+    return 0;
+}
+
+int codec_encode_batch(codec_iov_t iov[], int n)
+{
+    codec_iov_t *v;
+    int total;
+    int i;
+
+    total = 0;
+    for (i = 0;  i < n;  i++)
+    {
+        v = &iov[i];
+        if (v->session == NULL)
+            return -1;
+        if (v->session->codec == CODEC_G711)
+            v->out_len = g711_encode(&v->session->state.g711, (uint8_t *) v->out, (const int16_t *) v->in, v->in_len);
+        else
+            v->out_len = g726_encode(&v->session->state.g726, (uint8_t *) v->out, (const int16_t *) v->in, v->in_len);
+        total += v->out_len;
+    }
+    return total;
+}
+
+int codec_decode_batch(codec_iov_t iov[], int n)
+{
+    codec_iov_t *v;
+    int total;
+    int i;
+
+    total = 0;
+    for (i = 0;  i < n;  i++)
+    {
+        v = &iov[i];
+        if (v->session == NULL)
+            return -1;
+        if (v->session->codec == CODEC_G711)
+            v->out_len = g711_decode(&v->session->state.g711, (int16_t *) v->out, (const uint8_t *) v->in, v->in_len);
+        else
+            v->out_len = g726_decode(&v->session->state.g726, (int16_t *) v->out, (const uint8_t *) v->in, v->in_len);
+        total += v->out_len;
+    }
+    return total;
+}
@@ -0,0 +1,97 @@
+/*
+ * codec.h - Batch G.711/G.726 codec sessions
+ */
+
+#if !defined(_CODEC_H_)
+#define _CODEC_H_
+
+#include <stdint.h>
+#include <spandsp.h>
+/* The sessions embed the spandsp codec states, so they can be placed in
+   caller supplied storage without any allocation. The private headers are
+   included directly, so it does not matter whether spandsp.h was already
+   included without SPANDSP_EXPOSE_INTERNAL_STRUCTURES. */
+#include <spandsp/private/bitstream.h>
+#include <spandsp/private/g711.h>
+#include <spandsp/private/g726.h>
+
+enum
+{
+    CODEC_G711 = 1,
+    CODEC_G726 = 2
+};
+
+typedef struct
+{
+    /*! CODEC_G711 or CODEC_G726. */
+    int codec;
+    /*! G711_ALAW or G711_ULAW for G.711. G726_ENCODING_xxx for G.726. */
+    int law;
+    /*! The bit rate, in bits/s. */
+    int bit_rate;
+    union
+    {
+        g711_state_t g711;
+        g726_state_t g726;
+    } state;
+} codec_session_t;
+
+/*! One buffer of a batch. A batch may hold any mix of sessions, and several
+    consecutive frames for the same session, which are processed in order. */
+typedef struct
+{
+    /*! The session this buffer belongs to. */
+    codec_session_t *session;
+    /*! int16_t samples when encoding, one codeword per byte when decoding.
+        The samples are linear, except for G.726 sessions using
+        G726_ENCODING_ULAW or G726_ENCODING_ALAW, where each int16_t holds
+        one G.711 code. */
+    const void *in;
+    /*! The number of samples (encoding) or bytes (decoding) at in. */
+    int in_len;
+    /*! Codewords when encoding, int16_t samples when decoding, in the same
+        form as the input to the encoder. The buffer must have room for
+        in_len entries. */
+    void *out;
+    /*! Set to the number of bytes (encoding) or samples (decoding) produced. */
+    int out_len;
+} codec_iov_t;
+
+/*! Initialise a codec session.
+    \param s The session, or NULL to allocate one.
+    \param codec CODEC_G711 or CODEC_G726.
+    \param law G711_ALAW or G711_ULAW for G.711. G726_ENCODING_xxx for G.726.
+    \param bit_rate 64000 for G.711. 16000, 24000, 32000 or 40000 for G.726.
+    \return The session, or NULL on failure. */
+codec_session_t *codec_session_init(codec_session_t *s, int codec, int law, int bit_rate);
+
+int codec_session_release(codec_session_t *s);
+
+int codec_session_free(codec_session_t *s);
+
+/*! Change the bit rate of a session between frames. For G.726 the adaptive
+    predictor and scale factor state carry across the change, so there is no
+    reconvergence transient. This never allocates, and takes constant time.
+    \param s The session.
+    \param bit_rate The new bit rate, as for codec_session_init().
+    \return 0 for OK, or -1 if the bit rate is not valid for the codec. */
+int codec_session_set_bit_rate(codec_session_t *s, int bit_rate);
+
+/*! Encode a batch of buffers. Sessions hold no shared state, so separate
+    threads may run batches concurrently as long as no session appears in
+    more than one of them at a time.
+    \param iov The buffers.
+    \param n The number of buffers.
+    \return The total number of bytes produced, or -1 if a buffer refers to
+            no session. */
+int codec_encode_batch(codec_iov_t iov[], int n);
+
+/*! Decode a batch of buffers. The same threading rules as for
+    codec_encode_batch() apply.
+    \param iov The buffers.
+    \param n The number of buffers.
+    \return The total number of samples produced, or -1 if a buffer refers
+            to no session. */
+int codec_decode_batch(codec_iov_t iov[], int n);
+
+#endif
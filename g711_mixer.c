@@ -0,0 +1,133 @@
+/*
+ * g711_mixer.c - N-party conference mixing directly on G.711 legs
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <spandsp.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "g711_mixer.h"
+
+g711_mixer_state_t *g711_mixer_init(g711_mixer_state_t *s, int law)
+{
+    int i;
+
+    if (law != G711_ALAW  &&  law != G711_ULAW)
+        return NULL;
+    if (s == NULL)
+    {
+        if ((s = (g711_mixer_state_t *) aligned_alloc(16, sizeof(*s))) == NULL)
+            return NULL;
+    }
+    memset(s, 0, sizeof(*s));
+    s->law = law;
+    for (i = 0;  i < 256;  i++)
+        s->expand[i] = (law == G711_ALAW)  ?  alaw_to_linear((uint8_t) i)  :  ulaw_to_linear((uint8_t) i);
+    return s;
+}
+
+int g711_mixer_release(g711_mixer_state_t *s)
+{
+    return 0;
+}
+
+int g711_mixer_free(g711_mixer_state_t *s)
+{
+    free(s);
+    return 0;
+}
+
+static void expand_leg(const g711_mixer_state_t *s, int16_t amp[], const uint8_t g711_data[], int len)
+{
+    int i;
+
+    for (i = 0;  i < len;  i++)
+        amp[i] = s->expand[g711_data[i]];
+}
+
+static void accumulate(int32_t total[], const int16_t amp[], int len)
+{
+    int i;
+
+    i = 0;
+#if defined(__SSE2__)
+    for (  ;  i + 8 <= len;  i += 8)
+    {
+        __m128i a;
+        __m128i sign;
+
+        a = _mm_load_si128((const __m128i *) &amp[i]);
+        sign = _mm_srai_epi16(a, 15);
+        _mm_store_si128((__m128i *) &total[i], _mm_add_epi32(_mm_load_si128((const __m128i *) &total[i]), _mm_unpacklo_epi16(a, sign)));
+        _mm_store_si128((__m128i *) &total[i + 4], _mm_add_epi32(_mm_load_si128((const __m128i *) &total[i + 4]), _mm_unpackhi_epi16(a, sign)));
+    }
+#endif
+    for (  ;  i < len;  i++)
+        total[i] += amp[i];
+}
+
+static void exclude_and_saturate(int16_t mix[], const int32_t total[], const int16_t amp[], int len)
+{
+    int i;
+    int32_t x;
+
+    i = 0;
+#if defined(__SSE2__)
+    for (  ;  i + 8 <= len;  i += 8)
+    {
+        __m128i a;
+        __m128i sign;
+        __m128i lo;
+        __m128i hi;
+
+        a = _mm_load_si128((const __m128i *) &amp[i]);
+        sign = _mm_srai_epi16(a, 15);
+        lo = _mm_sub_epi32(_mm_load_si128((const __m128i *) &total[i]), _mm_unpacklo_epi16(a, sign));
+        hi = _mm_sub_epi32(_mm_load_si128((const __m128i *) &total[i + 4]), _mm_unpackhi_epi16(a, sign));
+        _mm_store_si128((__m128i *) &mix[i], _mm_packs_epi32(lo, hi));
+    }
+#endif
+    for (  ;  i < len;  i++)
+    {
+        x = total[i] - amp[i];
+        if (x > INT16_MAX)
+            x = INT16_MAX;
+        else if (x < INT16_MIN)
+            x = INT16_MIN;
+        mix[i] = (int16_t) x;
+    }
+}
+
+int g711_mixer_mix(g711_mixer_state_t *s, uint8_t *out[], const uint8_t *in[], int legs, int len)
+{
+    int i;
+    int j;
+
+    if (len < 0  ||  len > G711_MIXER_MAX_BLOCK  ||  legs < 0  ||  legs > G711_MIXER_MAX_LEGS)
+        return -1;
+    memset(s->total, 0, sizeof(s->total[0])*len);
+    for (i = 0;  i < legs;  i++)
+    {
+        expand_leg(s, s->leg, in[i], len);
+        accumulate(s->total, s->leg, len);
+    }
+    for (i = 0;  i < legs;  i++)
+    {
+        expand_leg(s, s->leg, in[i], len);
+        exclude_and_saturate(s->mix, s->total, s->leg, len);
+        if (s->law == G711_ALAW)
+        {
+            for (j = 0;  j < len;  j++)
+                out[i][j] = linear_to_alaw(s->mix[j]);
+        }
+        else
+        {
+            for (j = 0;  j < len;  j++)
+                out[i][j] = linear_to_ulaw(s->mix[j]);
+        }
+    }
+    return len;
+}
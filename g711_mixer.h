@@ -0,0 +1,53 @@
+/*
+ * g711_mixer.h - N-party conference mixing directly on G.711 legs
+ */
+
+#if !defined(_G711_MIXER_H_)
+#define _G711_MIXER_H_
+
+#include <stdint.h>
+
+/*! The largest frame, in samples, the mixer will process in one call. */
+#define G711_MIXER_MAX_BLOCK    320
+
+/*! The largest number of legs in one conference. The sum of this many 16 bit
+    samples always fits in the 32 bit accumulators, so only the final narrowing
+    to 16 bits needs to saturate. */
+#define G711_MIXER_MAX_LEGS     65536
+
+typedef struct
+{
+    /*! G711_ALAW or G711_ULAW. All legs of one mixer share the same law. */
+    int law;
+    /*! 256 entry expansion table for the law in use. */
+    int16_t expand[256];
+    /*! The sum of all legs for the current frame. */
+    int32_t total[G711_MIXER_MAX_BLOCK] __attribute__((aligned(16)));
+    /*! Scratch for one expanded leg. */
+    int16_t leg[G711_MIXER_MAX_BLOCK] __attribute__((aligned(16)));
+    /*! Scratch for one leg's "everyone but me" mix. */
+    int16_t mix[G711_MIXER_MAX_BLOCK] __attribute__((aligned(16)));
+} g711_mixer_state_t;
+
+/*! Initialise a mixer.
+    \param s The mixer context, or NULL to allocate one.
+    \param law G711_ALAW or G711_ULAW.
+    \return The mixer context, or NULL on failure. */
+g711_mixer_state_t *g711_mixer_init(g711_mixer_state_t *s, int law);
+
+int g711_mixer_release(g711_mixer_state_t *s);
+
+int g711_mixer_free(g711_mixer_state_t *s);
+
+/*! Mix one frame of a conference. Each leg receives the sum of every other
+    leg, formed by subtracting its own contribution from the total, so the cost
+    is linear in the number of legs.
+    \param s The mixer context.
+    \param out The G.711 output buffer for each leg.
+    \param in The G.711 input buffer for each leg.
+    \param legs The number of legs.
+    \param len The number of samples in each buffer.
+    \return The number of samples written to each output, or -1 on error. */
+int g711_mixer_mix(g711_mixer_state_t *s, uint8_t *out[], const uint8_t *in[], int legs, int len);
+
+#endif
@@ -0,0 +1,328 @@
+/*
+ * pacer.c - Real time frame pacing for large numbers of channels
+ */
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/timerfd.h>
+#include <sys/epoll.h>
+
+#include "pacer.h"
+
+static void list_init(pacer_list_t *l)
+{
+    l->next =
+    l->prev = l;
+}
+
+static void list_add_tail(pacer_list_t *l, pacer_list_t *item)
+{
+    item->prev = l->prev;
+    item->next = l;
+    l->prev->next = item;
+    l->prev = item;
+}
+
+static void list_del(pacer_list_t *item)
+{
+    item->prev->next = item->next;
+    item->next->prev = item->prev;
+    item->next =
+    item->prev = item;
+}
+
+/* Move the whole of one list onto another, leaving the first empty. */
+static void list_take(pacer_list_t *to, pacer_list_t *from)
+{
+    if (from->next == from)
+    {
+        list_init(to);
+        return;
+    }
+    to->next = from->next;
+    to->prev = from->prev;
+    to->next->prev = to;
+    to->prev->next = to;
+    list_init(from);
+}
+
+static void wheel_insert(pacer_state_t *s, pacer_timer_t *t)
+{
+    int64_t delta;
+    pacer_list_t *slot;
+    int shift;
+
+    delta = (int64_t) (t->expires - s->now);
+    if (delta < 0)
+    {
+        /* Already due. Run it on the next tick processed. */
+        slot = &s->level0[s->now & (PACER_LEVEL0_SIZE - 1)];
+    }
+    else if (delta < PACER_LEVEL0_SIZE)
+    {
+        slot = &s->level0[t->expires & (PACER_LEVEL0_SIZE - 1)];
+    }
+    else
+    {
+        if (delta > PACER_MAX_DELAY)
+        {
+            t->expires = s->now + PACER_MAX_DELAY;
+            delta = PACER_MAX_DELAY;
+        }
+        for (shift = 1;  shift < PACER_LEVELS - 1;  shift++)
+        {
+            if (delta < (1LL << (PACER_LEVEL0_BITS + shift*PACER_LEVELN_BITS)))
+                break;
+        }
+        slot = &s->leveln[shift - 1][(t->expires >> (PACER_LEVEL0_BITS + (shift - 1)*PACER_LEVELN_BITS)) & (PACER_LEVELN_SIZE - 1)];
+    }
+    list_add_tail(slot, &t->link);
+}
+
+/* Redistribute one slot of a higher level into the levels below it.
+   Returns the slot index, so the caller knows when to cascade further. */
+static int cascade(pacer_state_t *s, int level)
+{
+    pacer_list_t pending;
+    pacer_timer_t *t;
+    int index;
+
+    index = (int) ((s->now >> (PACER_LEVEL0_BITS + level*PACER_LEVELN_BITS)) & (PACER_LEVELN_SIZE - 1));
+    list_take(&pending, &s->leveln[level][index]);
+    while (pending.next != &pending)
+    {
+        t = (pacer_timer_t *) pending.next;
+        list_del(&t->link);
+        wheel_insert(s, t);
+    }
+    return index;
+}
+
+static void process_tick(pacer_state_t *s)
+{
+    pacer_list_t expired;
+    pacer_timer_t *t;
+    uint64_t tick;
+    uint32_t sleep;
+    int index;
+    int level;
+    int n;
+
+    tick = s->now;
+    index = (int) (tick & (PACER_LEVEL0_SIZE - 1));
+    if (index == 0)
+    {
+        for (level = 0;  level < PACER_LEVELS - 1;  level++)
+        {
+            if (cascade(s, level))
+                break;
+        }
+    }
+    list_take(&expired, &s->level0[index]);
+    s->now++;
+
+    n = 0;
+    while (expired.next != &expired)
+    {
+        t = (pacer_timer_t *) expired.next;
+        list_del(&t->link);
+        if (t->coro)
+        {
+            sleep = t->coro(t);
+            /* The coroutine may have cancelled its own timer, or cancelled
+               and re-added it, in which case it is already back in the
+               wheel. Either way, what it returned no longer applies. */
+            if (!t->active  ||  t->link.next != &t->link)
+                continue;
+            if (sleep)
+            {
+                t->expires = tick + sleep;
+                wheel_insert(s, t);
+            }
+            else
+            {
+                t->active = false;
+            }
+            continue;
+        }
+        if (t->period)
+        {
+            /* Re-arm from the due time, not the run time, so periodic timers
+               never drift. */
+            t->expires += t->period;
+            wheel_insert(s, t);
+        }
+        else
+        {
+            t->active = false;
+            s->timers--;
+        }
+        s->due[n++] = t;
+    }
+    if (n)
+        s->handler(s->user_data, s->due, n, tick);
+}
+
+static int64_t monotonic_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t) ts.tv_sec*1000000000 + ts.tv_nsec;
+}
+
+pacer_state_t *pacer_init(pacer_state_t *s, int tick_us, pacer_batch_handler_t handler, void *user_data)
+{
+    pacer_state_t *t;
+    struct itimerspec its;
+    struct epoll_event ev;
+    int i;
+    int j;
+
+    if (tick_us <= 0  ||  handler == NULL)
+        return NULL;
+    t = s;
+    if (t == NULL)
+    {
+        if ((t = (pacer_state_t *) malloc(sizeof(*t))) == NULL)
+            return NULL;
+    }
+    memset(t, 0, sizeof(*t));
+    t->tick_ns = (int64_t) tick_us*1000;
+    t->handler = handler;
+    t->user_data = user_data;
+    for (i = 0;  i < PACER_LEVEL0_SIZE;  i++)
+        list_init(&t->level0[i]);
+    for (i = 0;  i < PACER_LEVELS - 1;  i++)
+    {
+        for (j = 0;  j < PACER_LEVELN_SIZE;  j++)
+            list_init(&t->leveln[i][j]);
+    }
+    t->epoll_fd = -1;
+    if ((t->timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC)) < 0)
+        goto fail;
+    if ((t->epoll_fd = epoll_create1(EPOLL_CLOEXEC)) < 0)
+        goto fail;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.fd = t->timer_fd;
+    if (epoll_ctl(t->epoll_fd, EPOLL_CTL_ADD, t->timer_fd, &ev) < 0)
+        goto fail;
+    t->start_ns = monotonic_ns() + t->tick_ns;
+    its.it_value.tv_sec = t->start_ns/1000000000;
+    its.it_value.tv_nsec = t->start_ns%1000000000;
+    its.it_interval.tv_sec = t->tick_ns/1000000000;
+    its.it_interval.tv_nsec = t->tick_ns%1000000000;
+    if (timerfd_settime(t->timer_fd, TFD_TIMER_ABSTIME, &its, NULL) < 0)
+        goto fail;
+    return t;
+
+fail:
+    if (t->epoll_fd >= 0)
+        close(t->epoll_fd);
+    if (t->timer_fd >= 0)
+        close(t->timer_fd);
+    if (s == NULL)
+        free(t);
+    return NULL;
+}
+
+int pacer_release(pacer_state_t *s)
+{
+    close(s->epoll_fd);
+    close(s->timer_fd);
+    free(s->due);
+    s->due = NULL;
+    s->due_size = 0;
+    return 0;
+}
+
+int pacer_free(pacer_state_t *s)
+{
+    pacer_release(s);
+    free(s);
+    return 0;
+}
+
+int pacer_add(pacer_state_t *s, pacer_timer_t *t, uint32_t delay, uint32_t period, void *user_data)
+{
+    pacer_timer_t **due;
+    int size;
+
+    if (t->active)
+        return -1;
+    if (s->timers >= s->due_size)
+    {
+        size = (s->due_size)  ?  2*s->due_size  :  1024;
+        if ((due = (pacer_timer_t **) realloc(s->due, size*sizeof(due[0]))) == NULL)
+            return -1;
+        s->due = due;
+        s->due_size = size;
+    }
+    t->expires = s->now + delay;
+    t->period = period;
+    t->coro = NULL;
+    t->coro_line = 0;
+    t->user_data = user_data;
+    t->active = true;
+    s->timers++;
+    wheel_insert(s, t);
+    return 0;
+}
+
+int pacer_add_coro(pacer_state_t *s, pacer_timer_t *t, uint32_t delay, pacer_coro_func_t coro, void *user_data)
+{
+    if (t->active  ||  coro == NULL)
+        return -1;
+    t->expires = s->now + delay;
+    t->period = 0;
+    t->coro = coro;
+    t->coro_line = 0;
+    t->user_data = user_data;
+    t->active = true;
+    wheel_insert(s, t);
+    return 0;
+}
+
+int pacer_cancel(pacer_state_t *s, pacer_timer_t *t)
+{
+    if (!t->active)
+        return -1;
+    list_del(&t->link);
+    t->active = false;
+    if (t->coro == NULL)
+        s->timers--;
+    return 0;
+}
+
+void pacer_advance(pacer_state_t *s, uint64_t ticks)
+{
+    while (ticks--)
+        process_tick(s);
+}
+
+int pacer_run(pacer_state_t *s, int timeout_ms)
+{
+    struct epoll_event ev;
+    uint64_t expirations;
+    int n;
+
+    if ((n = epoll_wait(s->epoll_fd, &ev, 1, timeout_ms)) < 0)
+        return -1;
+    if (n == 0)
+        return 0;
+    if (read(s->timer_fd, &expirations, sizeof(expirations)) != sizeof(expirations))
+        return 0;
+    if (expirations > 1)
+        s->overruns += expirations - 1;
+    pacer_advance(s, expirations);
+    return (int) expirations;
+}
+
+int64_t pacer_tick_time_ns(const pacer_state_t *s, uint64_t tick)
+{
+    return s->start_ns + (int64_t) tick*s->tick_ns;
+}
@@ -0,0 +1,140 @@
+/*
+ * pacer.h - Real time frame pacing for large numbers of channels
+ */
+
+#if !defined(_PACER_H_)
+#define _PACER_H_
+
+#include <stdint.h>
+
+/* Wheel geometry. The first level resolves single ticks, and each further
+   level covers 64 slots of the level below. Four levels reach 2^26 ticks,
+   over 18 hours at 1ms ticks. Longer delays are clamped. */
+#define PACER_LEVEL0_BITS   8
+#define PACER_LEVELN_BITS   6
+#define PACER_LEVELS        4
+#define PACER_LEVEL0_SIZE   (1 << PACER_LEVEL0_BITS)
+#define PACER_LEVELN_SIZE   (1 << PACER_LEVELN_BITS)
+#define PACER_MAX_DELAY     ((1 << (PACER_LEVEL0_BITS + (PACER_LEVELS - 1)*PACER_LEVELN_BITS)) - 1)
+
+typedef struct pacer_list_s
+{
+    struct pacer_list_s *next;
+    struct pacer_list_s *prev;
+} pacer_list_t;
+
+typedef struct pacer_timer_s pacer_timer_t;
+
+/*! A stackless coroutine attached to a timer. It is resumed at the point it
+    last slept, and returns the number of ticks until it should next run, or
+    0 when it has finished. Nothing on its stack survives a sleep, so its
+    state belongs in the timer's user_data. */
+typedef uint32_t (*pacer_coro_func_t)(pacer_timer_t *t);
+
+/*! Called once per tick with every plain timer that fell due in that tick. */
+typedef void (*pacer_batch_handler_t)(void *user_data, pacer_timer_t *due[], int n, uint64_t tick);
+
+struct pacer_timer_s
+{
+    /*! Wheel slot membership. Must be first. */
+    pacer_list_t link;
+    /*! The tick at which the timer is next due. */
+    uint64_t expires;
+    /*! The repeat interval in ticks, or 0 for a one shot timer. */
+    uint32_t period;
+    /*! Non-zero while the timer is in the wheel. */
+    int active;
+    /*! The coroutine to resume when due, or NULL for a batched timer. */
+    pacer_coro_func_t coro;
+    /*! Where the coroutine resumes. Managed by the PACER_CORO_xxx macros. */
+    int coro_line;
+    void *user_data;
+};
+
+typedef struct
+{
+    /*! The length of a tick, in nanoseconds. */
+    int64_t tick_ns;
+    /*! The next tick to be processed. */
+    uint64_t now;
+    /*! CLOCK_MONOTONIC time of tick 0, in nanoseconds. */
+    int64_t start_ns;
+    int timer_fd;
+    int epoll_fd;
+    /*! Ticks which were processed late, because a wakeup covered more than
+        one tick. */
+    uint64_t overruns;
+    pacer_batch_handler_t handler;
+    void *user_data;
+    /*! Plain timers in the wheel, which bounds the size of a batch. */
+    int timers;
+    /*! Batch collection space, grown as timers are added so it is never
+        allocated in the tick path. */
+    pacer_timer_t **due;
+    int due_size;
+    pacer_list_t level0[PACER_LEVEL0_SIZE];
+    pacer_list_t leveln[PACER_LEVELS - 1][PACER_LEVELN_SIZE];
+} pacer_state_t;
+
+/*! Begin the body of a pacer coroutine. */
+#define PACER_CORO_BEGIN(t)         switch ((t)->coro_line) { case 0:
+
+/*! Suspend a pacer coroutine for a number of ticks (at least 1). */
+#define PACER_CORO_SLEEP(t, ticks)  do { (t)->coro_line = __LINE__; return (ticks); case __LINE__: ; } while (0)
+
+/*! End the body of a pacer coroutine, finishing it. */
+#define PACER_CORO_END(t)           } (t)->coro_line = 0; return 0
+
+/*! Initialise a pacer, with its own timerfd and epoll instance. One pacer is
+    meant to serve all the channels handled by one thread.
+    \param s The pacer context, or NULL to allocate one.
+    \param tick_us The tick length, in microseconds.
+    \param handler The batch handler for plain timers.
+    \param user_data An opaque pointer passed to the handler.
+    \return The pacer context, or NULL on failure. */
+pacer_state_t *pacer_init(pacer_state_t *s, int tick_us, pacer_batch_handler_t handler, void *user_data);
+
+int pacer_release(pacer_state_t *s);
+
+int pacer_free(pacer_state_t *s);
+
+/*! Add a plain timer, which is passed to the batch handler when due.
+    \param s The pacer context.
+    \param t The timer, in caller supplied storage, zeroed before first use.
+    \param delay The number of ticks until it is first due.
+    \param period The repeat interval in ticks, or 0 for one shot.
+    \param user_data An opaque pointer for the caller.
+    \return 0 for OK, or -1 on failure.
+    \note This may grow the batch array, so it must not be called from the
+          batch handler. */
+int pacer_add(pacer_state_t *s, pacer_timer_t *t, uint32_t delay, uint32_t period, void *user_data);
+
+/*! Add a timer which drives a stackless coroutine. The coroutine runs
+    directly from the tick, rather than as part of the batch.
+    \param s The pacer context.
+    \param t The timer, in caller supplied storage, zeroed before first use.
+    \param delay The number of ticks until it first runs.
+    \param coro The coroutine.
+    \param user_data An opaque pointer for the coroutine.
+    \return 0 for OK, or -1 on failure. */
+int pacer_add_coro(pacer_state_t *s, pacer_timer_t *t, uint32_t delay, pacer_coro_func_t coro, void *user_data);
+
+/*! Remove a timer, if it is active. This may be called from the batch
+    handler or a coroutine, including a coroutine removing its own timer,
+    whose return value is then ignored. */
+int pacer_cancel(pacer_state_t *s, pacer_timer_t *t);
+
+/*! Process a number of ticks immediately, without waiting for real time. */
+void pacer_advance(pacer_state_t *s, uint64_t ticks);
+
+/*! Wait for the next tick and process every tick that has fallen due.
+    \param s The pacer context.
+    \param timeout_ms The longest time to wait, or -1 to wait indefinitely.
+    \return The number of ticks processed, or -1 on error. */
+int pacer_run(pacer_state_t *s, int timeout_ms);
+
+/*! \return The CLOCK_MONOTONIC time, in nanoseconds, at which a tick was
+            due. */
+int64_t pacer_tick_time_ns(const pacer_state_t *s, uint64_t tick);
+
+#endif
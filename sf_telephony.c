@@ -0,0 +1,288 @@
+/*
+ * sf_telephony.c - Telephony audio file helpers shared by the test programs
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+#include <sndfile.h>
+#include <spandsp.h>
+
+#include </usr/include/spandsp/test_utils.h>
+
+#include "sf_telephony.h"
+
+/* Open handles are tracked in a hash table split into independently locked
+   shards, so threads opening and closing files rarely contend, and
+   registering or forgetting a handle costs O(1) however many are open. Each
+   shard is an open addressed table with linear probing, kept at most half
+   full. The shard is picked by the top bits of a multiplicative hash of the
+   handle's address, and the slot within it by the bits just below those.
+   The low bits of the product depend only on the low bits of the address,
+   which are all the same for handles allocated at a page multiple stride. */
+#define SF_REGISTRY_SHARD_BITS  6
+#define SF_REGISTRY_SHARDS      (1 << SF_REGISTRY_SHARD_BITS)
+#define SF_REGISTRY_MIN_SIZE    16
+
+typedef struct
+{
+    pthread_mutex_t lock;
+    SNDFILE **table;
+    int size;
+    /*! log2 of the size, once the table exists. */
+    int bits;
+    int count;
+} sf_registry_shard_t;
+
+static sf_registry_shard_t sf_registry[SF_REGISTRY_SHARDS];
+
+static pthread_once_t sf_registry_once = PTHREAD_ONCE_INIT;
+
+static uint64_t sf_handle_hash(SNDFILE *handle)
+{
+    return ((uint64_t) (uintptr_t) handle >> 4)*0x9E3779B97F4A7C15ULL;
+}
+
+static sf_registry_shard_t *sf_handle_shard(uint64_t hash)
+{
+    return &sf_registry[hash >> (64 - SF_REGISTRY_SHARD_BITS)];
+}
+
+static int sf_handle_slot(const sf_registry_shard_t *shard, uint64_t hash)
+{
+    return (int) ((hash << SF_REGISTRY_SHARD_BITS) >> (64 - shard->bits));
+}
+
+static void sf_close_at_exit(void)
+{
+    sf_registry_shard_t *shard;
+    int i;
+    int j;
+
+    for (i = 0;  i < SF_REGISTRY_SHARDS;  i++)
+    {
+        shard = &sf_registry[i];
+        pthread_mutex_lock(&shard->lock);
+        for (j = 0;  j < shard->size;  j++)
+        {
+            if (shard->table[j])
+            {
+                sf_close(shard->table[j]);
+                shard->table[j] = NULL;
+            }
+        }
+        shard->count = 0;
+        pthread_mutex_unlock(&shard->lock);
+    }
+}
+
+static void sf_registry_init(void)
+{
+    int i;
+
+    for (i = 0;  i < SF_REGISTRY_SHARDS;  i++)
+        pthread_mutex_init(&sf_registry[i].lock, NULL);
+    atexit(sf_close_at_exit);
+}
+
+static void sf_shard_insert(sf_registry_shard_t *shard, uint64_t hash, SNDFILE *handle)
+{
+    int i;
+
+    for (i = sf_handle_slot(shard, hash);  shard->table[i];  i = (i + 1) & (shard->size - 1))
+        ;
+    shard->table[i] = handle;
+}
+
+static int sf_shard_grow(sf_registry_shard_t *shard)
+{
+    SNDFILE **old;
+    int old_size;
+    int i;
+
+    old = shard->table;
+    old_size = shard->size;
+    shard->size = (old_size)  ?  2*old_size  :  SF_REGISTRY_MIN_SIZE;
+    if ((shard->table = (SNDFILE **) calloc(shard->size, sizeof(SNDFILE *))) == NULL)
+    {
+        shard->table = old;
+        shard->size = old_size;
+        return -1;
+    }
+    shard->bits = top_bit(shard->size);
+    for (i = 0;  i < old_size;  i++)
+    {
+        if (old[i])
+            sf_shard_insert(shard, sf_handle_hash(old[i]), old[i]);
+    }
+    free(old);
+    return 0;
+}
+
+int sf_telephony_record_handle(SNDFILE *handle)
+{
+    sf_registry_shard_t *shard;
+    uint64_t hash;
+    int res;
+
+    pthread_once(&sf_registry_once, sf_registry_init);
+    hash = sf_handle_hash(handle);
+    shard = sf_handle_shard(hash);
+    res = 0;
+    pthread_mutex_lock(&shard->lock);
+    if (2*(shard->count + 1) > shard->size)
+        res = sf_shard_grow(shard);
+    if (res == 0)
+    {
+        sf_shard_insert(shard, hash, handle);
+        shard->count++;
+    }
+    pthread_mutex_unlock(&shard->lock);
+    return res;
+}
+
+int sf_telephony_forget_handle(SNDFILE *handle)
+{
+    sf_registry_shard_t *shard;
+    uint64_t hash;
+    int mask;
+    int i;
+    int j;
+    int home;
+
+    pthread_once(&sf_registry_once, sf_registry_init);
+    hash = sf_handle_hash(handle);
+    shard = sf_handle_shard(hash);
+    pthread_mutex_lock(&shard->lock);
+    if (shard->size == 0)
+    {
+        pthread_mutex_unlock(&shard->lock);
+        return -1;
+    }
+    mask = shard->size - 1;
+    for (i = sf_handle_slot(shard, hash);  shard->table[i] != handle;  i = (i + 1) & mask)
+    {
+        if (shard->table[i] == NULL)
+        {
+            pthread_mutex_unlock(&shard->lock);
+            return -1;
+        }
+    }
+    /* Shift later members of the probe run back, so lookups never need
+       tombstones. */
+    shard->table[i] = NULL;
+    for (j = (i + 1) & mask;  shard->table[j];  j = (j + 1) & mask)
+    {
+        home = sf_handle_slot(shard, sf_handle_hash(shard->table[j]));
+        if (((j - home) & mask) >= ((j - i) & mask))
+        {
+            shard->table[i] = shard->table[j];
+            shard->table[j] = NULL;
+            i = j;
+        }
+    }
+    shard->count--;
+    pthread_mutex_unlock(&shard->lock);
+    return 0;
+}
+
+int sf_telephony_open_handles(void)
+{
+    int count;
+    int i;
+
+    pthread_once(&sf_registry_once, sf_registry_init);
+    count = 0;
+    for (i = 0;  i < SF_REGISTRY_SHARDS;  i++)
+    {
+        pthread_mutex_lock(&sf_registry[i].lock);
+        count += sf_registry[i].count;
+        pthread_mutex_unlock(&sf_registry[i].lock);
+    }
+    return count;
+}
+
+int sf_telephony_max_probe(void)
+{
+    sf_registry_shard_t *shard;
+    int longest;
+    int probe;
+    int i;
+    int j;
+
+    pthread_once(&sf_registry_once, sf_registry_init);
+    longest = 0;
+    for (i = 0;  i < SF_REGISTRY_SHARDS;  i++)
+    {
+        shard = &sf_registry[i];
+        pthread_mutex_lock(&shard->lock);
+        for (j = 0;  j < shard->size;  j++)
+        {
+            if (shard->table[j])
+            {
+                probe = (j - sf_handle_slot(shard, sf_handle_hash(shard->table[j]))) & (shard->size - 1);
+                if (probe > longest)
+                    longest = probe;
+            }
+        }
+        pthread_mutex_unlock(&shard->lock);
+    }
+    return longest;
+}
+
+SPAN_DECLARE(SNDFILE *) sf_open_telephony_read(const char *name, int channels)
+{
+    SNDFILE *handle;
+    SF_INFO info;
+
+    memset(&info, 0, sizeof(info));
+    if ((handle = sf_open(name, SFM_READ, &info)) == NULL)
+    {
+        fprintf(stderr, "    Cannot open audio file '%s' for reading\n", name);
+        exit(2);
+    }
+    if (info.samplerate != SAMPLE_RATE)
+    {
+        printf("    Unexpected sample rate in audio file '%s'\n", name);
+        exit(2);
+    }
+    if (info.channels != channels)
+    {
+        printf("    Unexpected number of channels in audio file '%s'\n", name);
+        exit(2);
+    }
+    sf_telephony_record_handle(handle);
+    return handle;
+}
+
+SPAN_DECLARE(SNDFILE *) sf_open_telephony_write(const char *name, int channels)
+{
+    SNDFILE *handle;
+    SF_INFO info;
+
+    memset(&info, 0, sizeof(info));
+    info.frames = 0;
+    info.samplerate = SAMPLE_RATE;
+    info.channels = channels;
+    info.format = SF_FORMAT_WAV | SF_FORMAT_PCM_16;
+    info.sections = 1;
+    info.seekable = 1;
+
+    if ((handle = sf_open(name, SFM_WRITE, &info)) == NULL)
+    {
+        fprintf(stderr, "    Cannot open audio file '%s' for writing\n", name);
+        exit(2);
+    }
+    sf_telephony_record_handle(handle);
+    return handle;
+}
+
+SPAN_DECLARE(int) sf_close_telephony(SNDFILE *handle)
+{
+    /* Forget the handle before closing it. Once closed, its address may be
+       reused by a file another thread is opening. */
+    sf_telephony_forget_handle(handle);
+    return sf_close(handle);
+}
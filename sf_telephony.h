@@ -0,0 +1,35 @@
+/*
+ * sf_telephony.h - Telephony audio file helpers shared by the test programs
+ *
+ * sf_open_telephony_read(), sf_open_telephony_write() and
+ * sf_close_telephony() are declared by spandsp's test_utils.h. Handles they
+ * open are closed automatically at exit if the program does not close them.
+ */
+
+#if !defined(_SF_TELEPHONY_H_)
+#define _SF_TELEPHONY_H_
+
+#include <sndfile.h>
+
+/*! \return The number of handles opened by the telephony helpers and not yet
+            closed. Safe to call from any thread. */
+int sf_telephony_open_handles(void);
+
+/*! Register a handle, as the open functions do. This is for testing the
+    registry with handles it did not open, which must be forgotten again
+    before exit, as anything still registered is closed then.
+    \param handle The handle.
+    \return 0 for OK, or -1 on failure. */
+int sf_telephony_record_handle(SNDFILE *handle);
+
+/*! Forget a registered handle, without closing it.
+    \param handle The handle.
+    \return 0 for OK, or -1 if the handle is not registered. */
+int sf_telephony_forget_handle(SNDFILE *handle);
+
+/*! \return The furthest any registered handle lies from its home slot in
+            the registry, which bounds the cost of registering and
+            forgetting handles. */
+int sf_telephony_max_probe(void);
+
+#endif
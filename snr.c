@@ -0,0 +1,33 @@
+/*
+ * snr.c - Signal to noise ratio of a decoded signal against its source
+ */
+
+#include <string.h>
+#include <math.h>
+
+#include "snr.h"
+
+snr_state_t *snr_init(snr_state_t *s)
+{
+    memset(s, 0, sizeof(*s));
+    return s;
+}
+
+void snr_update(snr_state_t *s, const int16_t input[], const int16_t output[], int len)
+{
+    int64_t diff;
+    int i;
+
+    for (i = 0;  i < len;  i++)
+    {
+        diff = (int64_t) input[i] - output[i];
+        s->sum_input += (int64_t) input[i]*input[i];
+        s->mse += diff*diff;
+    }
+    s->samples += len;
+}
+
+float snr_current_db(const snr_state_t *s)
+{
+    return 10*log10f(s->sum_input/(s->mse*1.0f));
+}
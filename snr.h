@@ -0,0 +1,28 @@
+/*
+ * snr.h - Signal to noise ratio of a decoded signal against its source
+ */
+
+#if !defined(_SNR_H_)
+#define _SNR_H_
+
+#include <stdint.h>
+
+typedef struct
+{
+    /*! Sum of the squared input samples. */
+    int64_t sum_input;
+    /*! Sum of the squared differences between input and output. */
+    int64_t mse;
+    /*! The number of samples compared. */
+    int samples;
+} snr_state_t;
+
+snr_state_t *snr_init(snr_state_t *s);
+
+/*! Accumulate one block of input samples and the matching output samples. */
+void snr_update(snr_state_t *s, const int16_t input[], const int16_t output[], int len);
+
+/*! \return The SNR so far, in dB. */
+float snr_current_db(const snr_state_t *s);
+
+#endif